@@ -0,0 +1,581 @@
+// benchmark.cpp : microbenchmarks for callback invocation and the message queues.
+//
+// Prints one JSON document (to stdout, or to --out <file>) so that runs of different releases
+// can be compared. Every case runs a fixed number of operations --repeat times: throughput is
+// the median run, latency percentiles pool the samples of all runs.
+//
+//   --filter <text>  only the cases whose name contains text
+//   --repeat <n>     runs per case (default 3)
+//   --quick          a tenth of the default operation counts
+//   --out <file>     write the JSON to file
+//
+// Windows: the benchmark project of Rancircle.sln (build Release). Linux, from this directory:
+//   g++ -std=c++17 -O2 -DNDEBUG -I../solution benchmark.cpp ../solution/CpuTopology.cpp
+//      ../solution/IPCMessageQueue.cpp ../solution/LocalMessageQueue.cpp ../solution/Metrics.cpp
+//      ../solution/NumaMessageQueue.cpp ../solution/PendingRequestTable.cpp
+//      ../solution/RingMessageQueue.cpp ../solution/SharedMemoryObject.cpp
+//      ../solution/SharedMemoryRing.cpp ../solution/SharedMemorySlab.cpp -pthread -lrt -o benchmark
+#include "callback.hpp"
+#include "callbackMng.hpp"
+#include "callbackDispatcher.hpp"
+#include "LocalMessageQueue.h"
+#include "IPCMessageQueue.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+   using Clock = std::chrono::steady_clock;
+   using ParameterPack = IMessageQueue::ParameterPack;
+
+   struct Options {
+      std::string filter;
+      size_t repeat = 3;
+      size_t divisor = 1; // 10 with --quick
+      std::string out;
+   };
+
+   // One JSON object; fields keep the order they were added in
+   class JsonObject {
+   public:
+      JsonObject& Add(const std::string& key, const std::string& value) {
+         std::string quoted = "\"";
+         for (char c : value) {
+            if (c == '"' || c == '\\') {
+               quoted += '\\';
+            }
+            quoted += c;
+         }
+         return AddRaw(key, quoted + "\"");
+      }
+
+      JsonObject& Add(const std::string& key, const char* value) {
+         return Add(key, std::string(value));
+      }
+
+      JsonObject& Add(const std::string& key, bool value) {
+         return AddRaw(key, value ? "true" : "false");
+      }
+
+      template<typename T, typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+      JsonObject& Add(const std::string& key, T value) {
+         if constexpr (std::is_integral_v<T>) {
+            return AddRaw(key, std::to_string(value));
+         }
+         else {
+            char text[32];
+            snprintf(text, sizeof(text), "%.9g", static_cast<double>(value));
+            return AddRaw(key, text);
+         }
+      }
+
+      JsonObject& Add(const std::string& key, const JsonObject& value) {
+         return AddRaw(key, value.Text());
+      }
+
+      JsonObject& AddRaw(const std::string& key, const std::string& json) {
+         text += (text.empty() ? "{" : ", ") + std::string("\"") + key + "\": " + json;
+         return *this;
+      }
+
+      std::string Text() const { return text.empty() ? "{}" : text + "}"; }
+
+   private:
+      std::string text;
+   };
+
+   // Latency samples from any number of threads, kept in the striped histograms of a
+   // MetricsRegistry so that recording does not make the threads contend
+   class LatencyRecorder {
+   public:
+      void Record(Clock::duration elapsed) { registry.HandlerRan(0, elapsed); }
+
+      HistogramSnapshot Snapshot() const {
+         MetricsSnapshot snapshot = registry.Snapshot();
+         const MessageMetrics* samples = snapshot.Find(0);
+         return samples ? samples->handler : HistogramSnapshot();
+      }
+
+   private:
+      MetricsRegistry registry;
+   };
+
+   JsonObject LatencyJson(const HistogramSnapshot& latency) {
+      return JsonObject()
+         .Add("samples", latency.count)
+         .Add("mean", latency.MeanNanos())
+         .Add("p50", latency.Percentile(0.5))
+         .Add("p90", latency.Percentile(0.9))
+         .Add("p99", latency.Percentile(0.99))
+         .Add("p999", latency.Percentile(0.999))
+         .Add("max", latency.MaxNanos());
+   }
+
+   double Median(std::vector<double> values) {
+      std::sort(values.begin(), values.end());
+      return values.empty() ? 0.0 : values[values.size() / 2];
+   }
+
+   double SecondsSince(Clock::time_point start) {
+      return std::chrono::duration<double>(Clock::now() - start).count();
+   }
+
+   // Steady-clock timestamp carried in a message parameter (exact to the nanosecond for the
+   // first 100 days of uptime)
+   double Stamp() {
+      return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+   }
+
+   Clock::duration Since(double stamp) {
+      auto then = Clock::time_point(std::chrono::duration_cast<Clock::duration>(
+         std::chrono::nanoseconds(static_cast<int64_t>(stamp))));
+      return Clock::now() - then;
+   }
+
+   // 1, 2, 4, ... up to the number of hardware threads (and that number itself)
+   std::vector<size_t> CoreCounts() {
+      size_t cores = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+      std::vector<size_t> counts;
+      for (size_t n = 1; n < cores; n *= 2) {
+         counts.push_back(n);
+      }
+      counts.push_back(cores);
+      return counts;
+   }
+
+   // Starts threads that all wait for one signal, runs body(index) on each and returns the wall
+   // time from the signal until the last one finished
+   template<typename Body>
+   double RunThreads(size_t threads, Body&& body) {
+      std::atomic<size_t> ready{ 0 };
+      std::atomic<bool> go{ false };
+      std::vector<std::thread> pool;
+      for (size_t i = 0; i < threads; ++i) {
+         pool.emplace_back([&, i] {
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire)) {
+               std::this_thread::yield();
+            }
+            body(i);
+         });
+      }
+      while (ready.load() < threads) {
+         std::this_thread::yield();
+      }
+      Clock::time_point start = Clock::now();
+      go.store(true, std::memory_order_release);
+      for (auto& thread : pool) {
+         thread.join();
+      }
+      return SecondsSince(start);
+   }
+
+   class Suite {
+   public:
+      explicit Suite(const Options& suiteOptions) : options(suiteOptions) {}
+
+      bool Selected(const std::string& name) const {
+         return options.filter.empty() || name.find(options.filter) != std::string::npos;
+      }
+
+      size_t Count(size_t full) const { return std::max<size_t>(full / options.divisor, 1); }
+      size_t Repeat() const { return std::max<size_t>(options.repeat, 1); }
+
+      void Add(const JsonObject& result) {
+         results.push_back(result.Text());
+         std::cerr << result.Text() << std::endl; // progress
+      }
+
+      std::string Json() const {
+         char timestamp[32];
+         std::time_t now = std::time(nullptr);
+         std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+         JsonObject header;
+         header.Add("suite", "rancircle-benchmark")
+            .Add("schema_version", 1)
+            .Add("timestamp", timestamp)
+            .Add("compiler", Compiler())
+#ifdef NDEBUG
+            .Add("build", "release")
+#else
+            .Add("build", "debug")
+#endif
+            .Add("hardware_threads", std::thread::hardware_concurrency())
+            .Add("numa_nodes", CpuTopology::Current().NodeCount())
+            .Add("repeat", Repeat())
+            .Add("quick", options.divisor > 1);
+
+         std::string json = header.Text();
+         json.pop_back();
+         json += ",\n  \"results\": [";
+         for (size_t i = 0; i < results.size(); ++i) {
+            json += (i == 0 ? "\n    " : ",\n    ") + results[i];
+         }
+         json += "\n  ]\n}\n";
+         return json;
+      }
+
+   private:
+      static std::string Compiler() {
+#if defined(_MSC_VER)
+         return "msvc " + std::to_string(_MSC_VER);
+#elif defined(__clang__)
+         return std::string("clang ") + __clang_version__;
+#elif defined(__GNUC__)
+         return std::string("gcc ") + __VERSION__;
+#else
+         return "unknown";
+#endif
+      }
+
+      Options options;
+      std::vector<std::string> results;
+   };
+
+   // Invocation throughput of call(i) on 1..cores threads. scaling is the throughput relative
+   // to threads times the single-thread throughput (1.0 is linear).
+   template<typename Call>
+   void InvokeScaling(Suite& suite, const std::string& name, size_t perThread, Call&& call) {
+      if (!suite.Selected(name)) {
+         return;
+      }
+      std::atomic<long long> sink{ 0 };
+      double single = 0.0;
+      for (size_t threads : CoreCounts()) {
+         std::vector<double> runs;
+         for (size_t run = 0; run < suite.Repeat(); ++run) {
+            runs.push_back(RunThreads(threads, [&](size_t) {
+               long long sum = 0;
+               for (size_t i = 0; i < perThread; ++i) {
+                  sum += call(static_cast<int>(i));
+               }
+               sink.fetch_add(sum);
+            }));
+         }
+         double seconds = Median(runs);
+         double opsPerSecond = threads * perThread / seconds;
+         if (threads == 1) {
+            single = opsPerSecond;
+         }
+         suite.Add(JsonObject()
+            .Add("name", name)
+            .Add("threads", threads)
+            .Add("operations", threads * perThread)
+            .Add("seconds", seconds)
+            .Add("ops_per_second", opsPerSecond)
+            .Add("ns_per_op", seconds * 1e9 / perThread)
+            .Add("scaling", single > 0 ? opsPerSecond / (threads * single) : 0.0));
+      }
+   }
+
+   void CallbackBenchmarks(Suite& suite) {
+      const size_t perThread = suite.Count(1000000);
+
+      CallbackManager manager;
+      manager.registerCallback(1, [](int a, int b) { return a + b; });
+      InvokeScaling(suite, "callback_manager.invoke", perThread, [&manager](int i) {
+         return manager.invoke<int>(1, i, 1);
+      });
+
+      // Readers while a writer keeps replacing another id: the invoke path takes no lock,
+      // so this should match callback_manager.invoke
+      if (suite.Selected("callback_manager.invoke_while_registering")) {
+         std::atomic<bool> stop{ false };
+         std::thread writer([&manager, &stop] {
+            for (int n = 0; !stop.load(); ++n) {
+               manager.registerCallback(2, [n](int a, int b) { return a * b + n; });
+               std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+         });
+         InvokeScaling(suite, "callback_manager.invoke_while_registering", perThread, [&manager](int i) {
+            return manager.invoke<int>(1, i, 1);
+         });
+         stop = true;
+         writer.join();
+      }
+
+      RxCallbackManager rx;
+      auto handle = rx.registerCallback(1, std::function<int(int, int)>([](int a, int b) { return a + b; }));
+      InvokeScaling(suite, "rx_callback_manager.invoke", perThread, [&rx](int i) {
+         return rx.invoke<int>(1, i, 1);
+      });
+      InvokeScaling(suite, "rx_callback_manager.invoke_typed", perThread, [&rx](int i) {
+         return rx.invokeTyped<int(int, int)>(1, i, 1);
+      });
+      InvokeScaling(suite, "rx_callback_manager.handle", perThread, [handle](int i) {
+         return handle(i, 1);
+      });
+   }
+
+   // onEvent from one thread into a pool of workers; latency is from onEvent to the start of
+   // the callback
+   void DispatcherBenchmarks(Suite& suite) {
+      const std::string name = "event_dispatcher.on_event";
+      if (!suite.Selected(name)) {
+         return;
+      }
+      const size_t events = suite.Count(200000);
+      for (size_t workers : CoreCounts()) {
+         auto executor = std::make_shared<ThreadPoolExecutor>(workers);
+         EventCallbackDispatcher dispatcher(executor);
+         LatencyRecorder latency;
+         dispatcher.registerCallback(1, [&latency](const Message& msg) {
+            latency.Record(Since(static_cast<double>(std::any_cast<intptr_t>(msg.wParam))));
+         });
+
+         std::vector<double> runs;
+         for (size_t run = 0; run < suite.Repeat(); ++run) {
+            Clock::time_point start = Clock::now();
+            for (size_t i = 0; i < events; ++i) {
+               dispatcher.onEvent(1, static_cast<intptr_t>(Stamp()), static_cast<intptr_t>(i));
+            }
+            dispatcher.drain();
+            runs.push_back(SecondsSince(start));
+         }
+         executor->shutdown();
+
+         double seconds = Median(runs);
+         suite.Add(JsonObject()
+            .Add("name", name)
+            .Add("workers", workers)
+            .Add("events", events)
+            .Add("seconds", seconds)
+            .Add("events_per_second", events / seconds)
+            .Add("latency_ns", LatencyJson(latency.Snapshot())));
+      }
+   }
+
+   // Producers queue messages as fast as they can; the run ends when the workers have handled
+   // them all. Latency (queue to handler) therefore includes the backlog of a saturated queue.
+   void LocalQueueCase(Suite& suite, size_t producers, size_t workers, size_t payload, bool metrics) {
+      const size_t perProducer = suite.Count(200000) / producers;
+      const size_t total = perProducer * producers;
+      const std::string body(payload, 'x');
+
+      LocalMessageQueue queue(workers);
+      LatencyRecorder latency;
+      std::atomic<size_t> handled{ 0 };
+      queue.RegisterHandler(1, [&latency, &handled](const ParameterPack& params) {
+         latency.Record(Since(std::get<double>(params[0])));
+         handled.fetch_add(1, std::memory_order_relaxed);
+      });
+      queue.EnableMetrics(metrics);
+      queue.Start();
+
+      std::vector<double> runs;
+      for (size_t run = 0; run < suite.Repeat(); ++run) {
+         handled = 0;
+         Clock::time_point start = Clock::now();
+         RunThreads(producers, [&](size_t) {
+            for (size_t i = 0; i < perProducer; ++i) {
+               if (payload == 0) {
+                  queue.QueueMessage(1, Stamp());
+               }
+               else {
+                  queue.QueueMessage(1, Stamp(), body);
+               }
+            }
+         });
+         while (handled.load() < total) {
+            std::this_thread::yield();
+         }
+         runs.push_back(SecondsSince(start));
+      }
+      queue.Stop();
+
+      double seconds = Median(runs);
+      suite.Add(JsonObject()
+         .Add("name", "local_queue.end_to_end")
+         .Add("producers", producers)
+         .Add("workers", workers)
+         .Add("payload_bytes", payload)
+         .Add("metrics", metrics)
+         .Add("messages", total)
+         .Add("seconds", seconds)
+         .Add("messages_per_second", total / seconds)
+         .Add("latency_ns", LatencyJson(latency.Snapshot())));
+   }
+
+   void LocalQueueBenchmarks(Suite& suite) {
+      if (!suite.Selected("local_queue.end_to_end")) {
+         return;
+      }
+      // A fixed grid, so results line up across machines
+      for (size_t payload : { 0, 64, 1024 }) {
+         for (size_t producers : { 1, 2, 4 }) {
+            for (size_t workers : { 1, 2, 4 }) {
+               LocalQueueCase(suite, producers, workers, payload, false);
+            }
+         }
+      }
+      LocalQueueCase(suite, 1, 1, 0, true); // the cost of MetricsRegistry
+   }
+
+#ifndef _WIN32
+   // Sequential requests to an echo server in a child process; payloads above the ring slot
+   // size travel through the shared-memory slab
+   void IpcBenchmarks(Suite& suite) {
+      const std::string name = "ipc_queue.round_trip";
+      if (!suite.Selected(name)) {
+         return;
+      }
+      const std::string queueName = "rancircle_bench_" + std::to_string(getpid());
+      int ready[2];
+      int done[2];
+      if (pipe(ready) != 0 || pipe(done) != 0) {
+         suite.Add(JsonObject().Add("name", name).Add("error", "pipe failed"));
+         return;
+      }
+
+      pid_t child = fork();
+      if (child == 0) {
+         close(ready[0]);
+         close(done[1]);
+         char signal = 1;
+         {
+            IPCMessageQueue server(queueName, 1);
+            server.RegisterRequestHandler(1, [](const ParameterPack& params) {
+               IMessageQueue::Reply reply;
+               reply.emplace_back(static_cast<int>(params.size()));
+               return reply;
+            });
+            server.Start();
+            if (write(ready[1], &signal, 1) != 1) {
+               _exit(1);
+            }
+            while (read(done[0], &signal, 1) > 0) {
+               // the parent closes its end when it is done
+            }
+            server.Stop();
+         }
+         _exit(0);
+      }
+      close(ready[1]);
+      close(done[0]);
+
+      char signal = 0;
+      if (child < 0 || read(ready[0], &signal, 1) != 1) {
+         suite.Add(JsonObject().Add("name", name).Add("error", "echo server did not start"));
+      }
+      else {
+         IPCMessageQueue client(queueName, 0);
+         client.Start();
+         for (size_t payload : { 0, 1024, 65536 }) {
+            const size_t requests = suite.Count(payload > 4096 ? 5000 : 20000);
+            const std::string body(payload, 'x');
+            auto request = [&client, &body, payload] {
+               if (payload == 0) {
+                  client.Request(1, 0).get();
+               }
+               else {
+                  client.Request(1, 0, body).get();
+               }
+            };
+            for (size_t i = 0; i < 100; ++i) {
+               request(); // warm-up
+            }
+
+            HistogramSnapshot latency;
+            std::vector<double> runs;
+            for (size_t run = 0; run < suite.Repeat(); ++run) {
+               Clock::time_point start = Clock::now();
+               for (size_t i = 0; i < requests; ++i) {
+                  Clock::time_point sent = Clock::now();
+                  request();
+                  auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - sent).count();
+                  ++latency.buckets[HistogramSnapshot::BucketOf(static_cast<uint64_t>(nanos))];
+                  ++latency.count;
+                  latency.sumNanos += static_cast<uint64_t>(nanos);
+               }
+               runs.push_back(SecondsSince(start));
+            }
+
+            double seconds = Median(runs);
+            suite.Add(JsonObject()
+               .Add("name", name)
+               .Add("payload_bytes", payload)
+               .Add("requests", requests)
+               .Add("seconds", seconds)
+               .Add("requests_per_second", requests / seconds)
+               .Add("latency_ns", LatencyJson(latency)));
+         }
+         client.Stop();
+      }
+      close(ready[0]);
+      close(done[1]);
+      if (child > 0) {
+         int status = 0;
+         waitpid(child, &status, 0);
+      }
+   }
+#endif
+
+   bool ParseOptions(int argc, char** argv, Options& options) {
+      for (int i = 1; i < argc; ++i) {
+         std::string arg = argv[i];
+         bool hasValue = i + 1 < argc;
+         if (arg == "--filter" && hasValue) {
+            options.filter = argv[++i];
+         }
+         else if (arg == "--repeat" && hasValue) {
+            options.repeat = static_cast<size_t>(std::stoul(argv[++i]));
+         }
+         else if (arg == "--quick") {
+            options.divisor = 10;
+         }
+         else if (arg == "--out" && hasValue) {
+            options.out = argv[++i];
+         }
+         else {
+            std::cerr << "usage: benchmark [--filter text] [--repeat n] [--quick] [--out file]" << std::endl;
+            return false;
+         }
+      }
+      return true;
+   }
+}
+
+int main(int argc, char** argv) {
+   Options options;
+   if (!ParseOptions(argc, argv, options)) {
+      return 2;
+   }
+
+   Suite suite(options);
+#ifndef _WIN32
+   IpcBenchmarks(suite); // first: forks, so no other threads should be running yet
+#endif
+   CallbackBenchmarks(suite);
+   DispatcherBenchmarks(suite);
+   LocalQueueBenchmarks(suite);
+
+   std::string json = suite.Json();
+   if (options.out.empty()) {
+      std::cout << json;
+   }
+   else {
+      std::ofstream file(options.out);
+      file << json;
+      if (!file) {
+         std::cerr << "cannot write " << options.out << std::endl;
+         return 1;
+      }
+   }
+   return 0;
+}
\ No newline at end of file
@@ -0,0 +1,226 @@
+#include "CpuTopology.h"
+#include <algorithm>
+#include <exception>
+#include <fstream>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+#ifndef _WIN32
+   // Parses a sysfs CPU/node list such as "0-3,8-11"
+   CpuSet ParseList(const std::string& text) {
+      CpuSet result;
+      size_t pos = 0;
+      while (pos < text.size()) {
+         size_t end = text.find(',', pos);
+         if (end == std::string::npos) {
+            end = text.size();
+         }
+         std::string range = text.substr(pos, end - pos);
+         size_t dash = range.find('-');
+         try {
+            unsigned first = static_cast<unsigned>(std::stoul(range.substr(0, dash)));
+            unsigned last = dash == std::string::npos ? first : static_cast<unsigned>(std::stoul(range.substr(dash + 1)));
+            for (unsigned cpu = first; cpu <= last; ++cpu) {
+               result.push_back(cpu);
+            }
+         }
+         catch (const std::exception&) {
+            // Skip malformed entries (e.g. the trailing newline)
+         }
+         pos = end + 1;
+      }
+      return result;
+   }
+
+   CpuSet ReadList(const std::string& path) {
+      std::ifstream file(path);
+      std::string text;
+      std::getline(file, text);
+      return ParseList(text);
+   }
+#endif
+
+   // CPUs the process may run on (empty if the platform would not say)
+   CpuSet ReadAffinity() {
+      CpuSet cpus;
+#ifdef _WIN32
+      DWORD_PTR process = 0, system = 0;
+      if (GetProcessAffinityMask(GetCurrentProcess(), &process, &system)) {
+         for (unsigned cpu = 0; cpu < sizeof(DWORD_PTR) * 8; ++cpu) {
+            if (process & (static_cast<DWORD_PTR>(1) << cpu)) {
+               cpus.push_back(cpu);
+            }
+         }
+      }
+#else
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+         for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+               cpus.push_back(cpu);
+            }
+         }
+      }
+#endif
+      return cpus;
+   }
+
+   // The mask is read on first use; the initializer below makes that happen during static
+   // initialization on the main thread, before any worker has been pinned
+   const CpuSet& StartupAffinity() {
+      static const CpuSet cpus = ReadAffinity();
+      return cpus;
+   }
+
+   const bool startupAffinityRead = !StartupAffinity().empty();
+}
+
+const CpuTopology& CpuTopology::Current() {
+   static const CpuTopology topology;
+   return topology;
+}
+
+CpuTopology::CpuTopology()
+   : allowed(StartupAffinity())
+{
+#ifdef _WIN32
+   ULONG highest = 0;
+   if (GetNumaHighestNodeNumber(&highest)) {
+      for (ULONG node = 0; node <= highest; ++node) {
+         ULONGLONG mask = 0;
+         if (!GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask) || mask == 0) {
+            continue;
+         }
+         CpuSet cpus;
+         for (unsigned cpu = 0; cpu < 64; ++cpu) {
+            if (mask & (1ull << cpu)) {
+               cpus.push_back(cpu);
+            }
+         }
+         nodes.push_back(std::move(cpus));
+      }
+   }
+#else
+   for (unsigned node : ReadList("/sys/devices/system/node/online")) {
+      CpuSet cpus = ReadList("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+      if (!cpus.empty()) {
+         nodes.push_back(std::move(cpus)); // memory-only nodes have no workers to place
+      }
+   }
+#endif
+   if (!allowed.empty()) {
+      for (CpuSet& cpus : nodes) {
+         cpus.erase(std::remove_if(cpus.begin(), cpus.end(), [this](unsigned cpu) {
+            return !std::binary_search(allowed.begin(), allowed.end(), cpu);
+            }), cpus.end());
+      }
+      nodes.erase(std::remove_if(nodes.begin(), nodes.end(), [](const CpuSet& cpus) { return cpus.empty(); }),
+         nodes.end());
+   }
+   if (nodes.empty()) {
+      CpuSet cpus = allowed;
+      if (cpus.empty()) {
+         unsigned count = std::thread::hardware_concurrency();
+         for (unsigned cpu = 0; cpu < (count == 0 ? 1 : count); ++cpu) {
+            cpus.push_back(cpu);
+         }
+      }
+      nodes.push_back(std::move(cpus));
+   }
+   if (allowed.empty()) {
+      allowed = AllCpus();
+   }
+
+   for (size_t node = 0; node < nodes.size(); ++node) {
+      for (unsigned cpu : nodes[node]) {
+         if (cpu >= nodeOfCpu.size()) {
+            nodeOfCpu.resize(cpu + 1, 0);
+         }
+         nodeOfCpu[cpu] = node;
+      }
+   }
+}
+
+CpuSet CpuTopology::AllCpus() const {
+   CpuSet cpus;
+   for (const CpuSet& node : nodes) {
+      cpus.insert(cpus.end(), node.begin(), node.end());
+   }
+   return cpus;
+}
+
+size_t CpuTopology::NodeOf(unsigned cpu) const {
+   return cpu < nodeOfCpu.size() ? nodeOfCpu[cpu] : 0;
+}
+
+size_t CpuTopology::CurrentNode() const {
+   if (nodes.size() == 1) {
+      return 0;
+   }
+#ifdef _WIN32
+   return NodeOf(GetCurrentProcessorNumber());
+#else
+   int cpu = sched_getcpu();
+   return cpu < 0 ? 0 : NodeOf(static_cast<unsigned>(cpu));
+#endif
+}
+
+bool CpuTopology::Pin(std::thread& thread, const CpuSet& cpus) {
+#ifdef _WIN32
+   DWORD_PTR mask = 0;
+   for (unsigned cpu : cpus) {
+      if (cpu < sizeof(DWORD_PTR) * 8) {
+         mask |= static_cast<DWORD_PTR>(1) << cpu;
+      }
+   }
+   return mask != 0 && SetThreadAffinityMask(thread.native_handle(), mask) != 0;
+#else
+   cpu_set_t set;
+   CPU_ZERO(&set);
+   bool any = false;
+   for (unsigned cpu : cpus) {
+      if (cpu < CPU_SETSIZE) {
+         CPU_SET(cpu, &set);
+         any = true;
+      }
+   }
+   return any && pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+#endif
+}
+
+bool WorkerPlacement::Apply(std::thread& thread, size_t worker) const {
+   const CpuSet* cpus = For(worker);
+   return CpuTopology::Pin(thread, cpus ? *cpus : CpuTopology::Current().AllowedCpus());
+}
+
+WorkerPlacement WorkerPlacement::PinToCores(const CpuSet& cpus) {
+   WorkerPlacement placement;
+   for (unsigned cpu : cpus) {
+      placement.workerCpus.push_back({ cpu });
+   }
+   return placement;
+}
+
+WorkerPlacement WorkerPlacement::OnNode(size_t node) {
+   const CpuTopology& topology = CpuTopology::Current();
+   WorkerPlacement placement;
+   placement.workerCpus.push_back(topology.NodeCpus(node < topology.NodeCount() ? node : 0));
+   return placement;
+}
+
+WorkerPlacement WorkerPlacement::AcrossNodes() {
+   const CpuTopology& topology = CpuTopology::Current();
+   WorkerPlacement placement;
+   for (size_t node = 0; node < topology.NodeCount(); ++node) {
+      placement.workerCpus.push_back(topology.NodeCpus(node));
+   }
+   return placement;
+}
\ No newline at end of file
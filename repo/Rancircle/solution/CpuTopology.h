@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Logical CPU numbers a thread may run on
+using CpuSet = std::vector<unsigned>;
+
+// NUMA layout of the machine: the CPUs of each node, read once from /sys/devices/system/node
+// on Linux and from the NUMA API on Windows (processor group 0). Without NUMA information the
+// machine is a single node holding every CPU. Only the CPUs of the affinity mask the process
+// started with (taskset, cpusets, job objects) are listed; nodes left without any are dropped.
+class CpuTopology {
+public:
+   static const CpuTopology& Current();
+
+   size_t NodeCount() const { return nodes.size(); }
+   const CpuSet& NodeCpus(size_t node) const { return nodes[node]; }
+   CpuSet AllCpus() const;
+   // The process's affinity mask, captured at startup before any worker was pinned
+   const CpuSet& AllowedCpus() const { return allowed; }
+   // Node of cpu (0 if unknown)
+   size_t NodeOf(unsigned cpu) const;
+   // Node of the CPU the calling thread is running on at the moment
+   size_t CurrentNode() const;
+
+   // Restricts thread to cpus. Returns false if cpus is empty or the platform refused.
+   static bool Pin(std::thread& thread, const CpuSet& cpus);
+
+private:
+   CpuTopology();
+
+   CpuSet allowed;
+   std::vector<CpuSet> nodes;
+   std::vector<size_t> nodeOfCpu;
+};
+
+// Which CPUs each worker of a queue may run on: worker i gets workerCpus[i % size].
+// Empty means no placement, so the scheduler may move workers anywhere the process may run.
+struct WorkerPlacement {
+   std::vector<CpuSet> workerCpus;
+
+   bool Empty() const { return workerCpus.empty(); }
+   const CpuSet* For(size_t worker) const {
+      return workerCpus.empty() ? nullptr : &workerCpus[worker % workerCpus.size()];
+   }
+   // Pins thread as worker number worker; with an empty placement, restores the process's
+   // startup affinity (CpuTopology::AllowedCpus)
+   bool Apply(std::thread& thread, size_t worker) const;
+
+   // One core per worker, in the given order (cores are reused when workers outnumber them)
+   static WorkerPlacement PinToCores(const CpuSet& cpus);
+   // Every worker may run on any CPU of node
+   static WorkerPlacement OnNode(size_t node);
+   // Worker i stays on node i % NodeCount(), free to move among that node's CPUs
+   static WorkerPlacement AcrossNodes();
+};
\ No newline at end of file
@@ -0,0 +1,389 @@
+#pragma once
+#include "messageQueue.h"
+#include "PendingRequestTable.h"
+#include "nodePool.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Copy-on-write handler table shared by the IMessageQueue implementations.
+// Workers load an immutable snapshot and run handlers without holding any lock, so
+// handlers for different messages execute in parallel across workers.
+// RegisterHandler copies the table and swaps it in atomically; a worker that already
+// holds the previous snapshot finishes with it and the old table is freed afterwards.
+// With the owning queue's metrics enabled, dispatches, handler times and handler exceptions
+// are recorded per id; otherwise the hooks cost one flag check per batch or message.
+class HandlerRegistry {
+public:
+   using Clock = MetricsRegistry::Clock;
+   using MessageId = IMessageQueue::MessageId;
+   using Parameter = IMessageQueue::Parameter;
+   using ParameterPack = IMessageQueue::ParameterPack;
+   using MessageHandler = IMessageQueue::MessageHandler;
+   using HandlerList = std::vector<MessageHandler>;
+   using BatchHandler = IMessageQueue::BatchHandler;
+   using Reply = IMessageQueue::Reply;
+   using RequestHandler = IMessageQueue::RequestHandler;
+   using PayloadHandler = IMessageQueue::PayloadHandler;
+   using JoinHandler = IMessageQueue::JoinHandler;
+   using Run = std::vector<ParameterPack>;
+
+   // Everything registered for one id
+   struct Handlers {
+      HandlerList perMessage;
+      std::vector<BatchHandler> batch;
+      std::vector<PayloadHandler> typed;
+      bool parallel = false; // fan out perMessage (see IMessageQueue::SetFanOut)
+      JoinHandler join;
+      std::shared_ptr<IExecutor> executor;
+   };
+
+   HandlerRegistry()
+      : table(std::make_shared<const HandlerMap>()), requestTable(std::make_shared<const RequestMap>()),
+        metrics(nullptr), fanOutsInFlight(0) {}
+
+   // The owning queue's metrics; set once, before the workers start
+   void SetMetrics(MetricsRegistry* queueMetrics) {
+      metrics = queueMetrics;
+   }
+
+   void Add(MessageId id, MessageHandler handler) {
+      std::lock_guard<std::mutex> lock(writeMutex);
+      auto next = std::make_shared<HandlerMap>(*std::atomic_load(&table));
+      (*next)[id].perMessage.push_back(std::move(handler));
+      std::atomic_store(&table, std::shared_ptr<const HandlerMap>(std::move(next)));
+   }
+
+   void AddBatch(MessageId id, BatchHandler handler) {
+      std::lock_guard<std::mutex> lock(writeMutex);
+      auto next = std::make_shared<HandlerMap>(*std::atomic_load(&table));
+      (*next)[id].batch.push_back(std::move(handler));
+      std::atomic_store(&table, std::shared_ptr<const HandlerMap>(std::move(next)));
+   }
+
+   void AddPayload(MessageId id, PayloadHandler handler) {
+      std::lock_guard<std::mutex> lock(writeMutex);
+      auto next = std::make_shared<HandlerMap>(*std::atomic_load(&table));
+      (*next)[id].typed.push_back(std::move(handler));
+      std::atomic_store(&table, std::shared_ptr<const HandlerMap>(std::move(next)));
+   }
+
+   void SetFanOut(MessageId id, bool parallel, JoinHandler onJoin, std::shared_ptr<IExecutor> executor) {
+      if (parallel && !executor) {
+         executor = ThreadPoolExecutor::shared();
+      }
+      std::lock_guard<std::mutex> lock(writeMutex);
+      auto next = std::make_shared<HandlerMap>(*std::atomic_load(&table));
+      Handlers& entry = (*next)[id];
+      entry.parallel = parallel;
+      entry.join = parallel ? std::move(onJoin) : nullptr;
+      entry.executor = parallel ? std::move(executor) : nullptr;
+      std::atomic_store(&table, std::shared_ptr<const HandlerMap>(std::move(next)));
+   }
+
+   // Blocks until the handlers of every fanned-out message have returned
+   void WaitForFanOuts() const {
+      std::unique_lock<std::mutex> lock(fanOutMutex);
+      fanOutDone.wait(lock, [this] { return fanOutsInFlight.load() == 0; });
+   }
+
+   // Returns the handlers for id (nullptr if none). The result keeps its snapshot alive.
+   std::shared_ptr<const Handlers> Find(MessageId id) const {
+      auto snapshot = std::atomic_load(&table);
+      auto it = snapshot->find(id);
+      if (it == snapshot->end()) {
+         return nullptr;
+      }
+      return std::shared_ptr<const Handlers>(std::move(snapshot), &it->second);
+   }
+
+   // Runs every handler registered for id on the calling thread; batch handlers get a run of one
+   void Dispatch(MessageId id, const ParameterPack& params) const {
+      MetricsRegistry* recording = Recording();
+      if (recording) {
+         recording->Dispatched(id, Clock::time_point(), Clock::now());
+      }
+      auto entry = Find(id);
+      if (!entry) {
+         return;
+      }
+      if (entry->parallel) {
+         FanOut(entry, id, ParameterPack(params), recording);
+      }
+      else {
+         RunHandlers(entry->perMessage, params, recording, id);
+      }
+      if (!entry->batch.empty()) {
+         RunBatchHandlers(entry->batch, Run{ params }, recording, id);
+      }
+   }
+
+   // Runs the typed handlers registered for id on a typed message's payload
+   void DispatchPayload(MessageId id, const MessagePayload& payload) const {
+      MetricsRegistry* recording = Recording();
+      if (recording) {
+         recording->Dispatched(id, Clock::time_point(), Clock::now());
+      }
+      RunPayloadHandlers(id, payload, recording);
+   }
+
+   // Rebuilds the payload of a typed message received from another process with the
+   // decoder of the first typed handler for id that accepts the bytes.
+   // Returns false if no handler is registered or none accepts them.
+   bool DecodePayload(MessageId id, const unsigned char* src, size_t size, MessagePayload& payload) const {
+      auto entry = Find(id);
+      if (!entry) {
+         return false;
+      }
+      for (const auto& handler : entry->typed) {
+         if (handler.decode && handler.decode(src, size, payload)) {
+            return true;
+         }
+      }
+      return false;
+   }
+
+   // Dispatches the messages a worker drained in one wakeup, in queue order. Consecutive
+   // messages with the same id form one run for the batch handlers; their parameters are
+   // moved into run (a buffer the worker reuses). Requests (correlation != 0) go to serve,
+   // typed messages (non-empty payload) to the typed handlers only.
+   // Message::enqueuedAt gives the wait time; it is Clock::time_point() when not stamped.
+   template<typename Message, typename Serve>
+   void DispatchDrained(std::vector<Message>& drained, Run& run, Serve&& serve) const {
+      MetricsRegistry* recording = Recording();
+      if (recording) {
+         Clock::time_point now = Clock::now();
+         for (const Message& msg : drained) {
+            recording->Dispatched(msg.id, msg.enqueuedAt, now);
+         }
+      }
+
+      size_t i = 0;
+      while (i < drained.size()) {
+         if (drained[i].correlation != 0) {
+            serve(drained[i]);
+            ++i;
+            continue;
+         }
+         if (drained[i].payload) {
+            RunPayloadHandlers(drained[i].id, drained[i].payload, recording);
+            ++i;
+            continue;
+         }
+         MessageId id = drained[i].id;
+         size_t end = i + 1;
+         while (end < drained.size() && drained[end].correlation == 0 && !drained[end].payload
+            && drained[end].id == id) {
+            ++end;
+         }
+
+         auto entry = Find(id);
+         if (entry) {
+            for (size_t k = i; k < end; ++k) {
+               if (!entry->parallel) {
+                  RunHandlers(entry->perMessage, drained[k].params, recording, id);
+               }
+               else if (entry->batch.empty()) {
+                  FanOut(entry, id, std::move(drained[k].params), recording);
+               }
+               else {
+                  FanOut(entry, id, ParameterPack(drained[k].params), recording); // the batch handlers need them too
+               }
+            }
+            if (!entry->batch.empty()) {
+               run.clear();
+               for (size_t k = i; k < end; ++k) {
+                  run.push_back(std::move(drained[k].params));
+               }
+               RunBatchHandlers(entry->batch, run, recording, id);
+            }
+         }
+         i = end;
+      }
+   }
+
+   void AddRequestHandler(MessageId id, RequestHandler handler) {
+      std::lock_guard<std::mutex> lock(writeMutex);
+      auto next = std::make_shared<RequestMap>(*std::atomic_load(&requestTable));
+      (*next)[id] = std::move(handler);
+      std::atomic_store(&requestTable, std::shared_ptr<const RequestMap>(std::move(next)));
+   }
+
+   // Runs the request handler for id and returns its reply.
+   // Throws RequestFailedException if there is none; exceptions from the handler propagate.
+   Reply Serve(MessageId id, const ParameterPack& params) const {
+      auto snapshot = std::atomic_load(&requestTable);
+      auto it = snapshot->find(id);
+      if (it == snapshot->end()) {
+         throw RequestFailedException("No request handler for message " + std::to_string(id));
+      }
+      MetricsRegistry* recording = Recording();
+      if (!recording) {
+         return it->second(params);
+      }
+      Clock::time_point start = Clock::now();
+      try {
+         Reply reply = it->second(params);
+         recording->HandlerRan(id, Clock::now() - start);
+         return reply;
+      }
+      catch (...) {
+         recording->HandlerRan(id, Clock::now() - start);
+         recording->HandlerFailed(id);
+         throw;
+      }
+   }
+
+   // In-process request: serves it on the calling worker and completes the pending entry
+   void Respond(MessageId id, const ParameterPack& params, PendingRequestTable& pending, uint64_t correlation) const {
+      Reply reply;
+      try {
+         reply = Serve(id, params);
+      }
+      catch (...) {
+         pending.Fail(correlation, std::current_exception());
+         return;
+      }
+      pending.Complete(correlation, std::move(reply));
+   }
+
+private:
+   using HandlerMap = std::map<MessageId, Handlers>;
+   using RequestMap = std::map<MessageId, RequestHandler>;
+
+   // One fanned-out message: the parameters every handler task reads, and the number of
+   // tasks still running. The last one runs the join handler and returns the node to its pool.
+   struct FanOutNode {
+      FanOutNode(const HandlerRegistry* owner, std::shared_ptr<const Handlers> handlers, MessageId messageId,
+         ParameterPack&& parameters, size_t count, MetricsRegistry* recording)
+         : registry(owner), entry(std::move(handlers)), id(messageId), params(std::move(parameters)), remaining(count),
+           metrics(recording) {}
+
+      const HandlerRegistry* registry;
+      std::shared_ptr<const Handlers> entry; // keeps its snapshot alive
+      MessageId id;
+      ParameterPack params;
+      std::atomic<size_t> remaining;
+      MetricsRegistry* metrics; // nullptr unless recording when the message was dispatched
+   };
+
+   std::shared_ptr<const HandlerMap> table;
+   std::shared_ptr<const RequestMap> requestTable;
+   std::mutex writeMutex;
+   MetricsRegistry* metrics;
+
+   mutable std::atomic<size_t> fanOutsInFlight;
+   mutable std::mutex fanOutMutex;
+   mutable std::condition_variable fanOutDone;
+
+   // Posts one task per handler; each task captures only the node and its handler's index,
+   // so posting does not allocate. A single handler gains nothing from a task and runs here.
+   void FanOut(const std::shared_ptr<const Handlers>& entry, MessageId id, ParameterPack&& params,
+      MetricsRegistry* recording) const {
+      const HandlerList& list = entry->perMessage;
+      if (list.size() <= 1) {
+         RunHandlers(list, params, recording, id);
+         RunJoin(*entry, id, params, recording);
+         return;
+      }
+
+      fanOutsInFlight.fetch_add(1);
+      FanOutNode* node = NodePool<FanOutNode>::instance().create(this, entry, id, std::move(params), list.size(), recording);
+      for (size_t i = 0; i < list.size(); ++i) {
+         bool posted = entry->executor->post([node, i]() {
+            RunHandler(node->entry->perMessage[i], node->params, node->metrics, node->id);
+            FinishFanOut(node, 1);
+            });
+         if (!posted) {
+            // The executor is shutting down: run the rest here
+            for (size_t k = i; k < list.size(); ++k) {
+               RunHandler(list[k], node->params, recording, id);
+            }
+            FinishFanOut(node, list.size() - i);
+            return;
+         }
+      }
+   }
+
+   static void FinishFanOut(FanOutNode* node, size_t tasks) {
+      if (node->remaining.fetch_sub(tasks, std::memory_order_acq_rel) != tasks) {
+         return;
+      }
+      const HandlerRegistry* registry = node->registry;
+      RunJoin(*node->entry, node->id, node->params, node->metrics);
+      NodePool<FanOutNode>::instance().destroy(node);
+
+      // Last: a queue waiting in Stop() may destroy the registry as soon as this reaches zero
+      std::lock_guard<std::mutex> lock(registry->fanOutMutex);
+      if (registry->fanOutsInFlight.fetch_sub(1) == 1) {
+         registry->fanOutDone.notify_all();
+      }
+   }
+
+   // The metrics to record into, or nullptr while they are disabled
+   MetricsRegistry* Recording() const {
+      return metrics && metrics->Enabled() ? metrics : nullptr;
+   }
+
+   // Runs one handler call; with recording set, its time and any exception count against id.
+   // Nothing may escape: a fanned-out task that threw would never reach FinishFanOut.
+   template<typename Call>
+   static void Invoke(MetricsRegistry* recording, MessageId id, Call&& call) {
+      if (!recording) {
+         try {
+            call();
+         }
+         catch (...) {
+            // Handle exception (log error, etc.)
+         }
+         return;
+      }
+      Clock::time_point start = Clock::now();
+      try {
+         call();
+      }
+      catch (...) {
+         recording->HandlerFailed(id);
+      }
+      recording->HandlerRan(id, Clock::now() - start);
+   }
+
+   void RunPayloadHandlers(MessageId id, const MessagePayload& payload, MetricsRegistry* recording) const {
+      auto entry = Find(id);
+      if (!entry) {
+         return;
+      }
+      for (const auto& handler : entry->typed) {
+         Invoke(recording, id, [&handler, &payload] { handler.handle(payload); });
+      }
+   }
+
+   static void RunJoin(const Handlers& entry, MessageId id, const ParameterPack& params, MetricsRegistry* recording) {
+      if (!entry.join) {
+         return;
+      }
+      Invoke(recording, id, [&entry, id, &params] { entry.join(id, params); });
+   }
+
+   static void RunHandler(const MessageHandler& handler, const ParameterPack& params, MetricsRegistry* recording,
+      MessageId id) {
+      Invoke(recording, id, [&handler, &params] { handler(params); });
+   }
+
+   static void RunHandlers(const HandlerList& list, const ParameterPack& params, MetricsRegistry* recording, MessageId id) {
+      for (const auto& handler : list) {
+         RunHandler(handler, params, recording, id);
+      }
+   }
+
+   static void RunBatchHandlers(const std::vector<BatchHandler>& list, const Run& run, MetricsRegistry* recording,
+      MessageId id) {
+      for (const auto& handler : list) {
+         Invoke(recording, id, [&handler, &run] { handler(run); });
+      }
+   }
+};
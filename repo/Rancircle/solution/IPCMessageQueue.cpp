@@ -1,16 +1,23 @@
 #include "IPCMessageQueue.h"
-#include <sstream>
+#include "ParameterCodec.h"
+#include <cstring>
+#include <cstddef>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <signal.h>
+#include <unistd.h>
+#endif
 
 IPCMessageQueue::IPCMessageQueue(const std::string& name, size_t numThreads)
-   : queueName(name), running(false), threadCount(numThreads)
+   : queueName(name), running(false), threadCount(numThreads), batchSize(DefaultBatchSize)
 {
 #ifdef _WIN32
    hMapFile = NULL;
    hMutex = NULL;
    hSemaphore = NULL;
-#else
-   msgId = -1;
 #endif
+   handlers.SetMetrics(&metrics);
 }
 
 IPCMessageQueue::~IPCMessageQueue() {
@@ -45,9 +52,14 @@ bool IPCMessageQueue::InitializeIPC() {
 }
    return true;
 #else
-   key = ftok(queueName.c_str(), 65);
-   msgId = msgget(key, IPC_CREAT | 0666);
-   return (msgId != -1);
+   if (!ring.Open(queueName, RingSlotCount, sizeof(SharedMessage::data))) {
+      return false;
+   }
+   if (!slab.Open(queueName + ".slab", SlabBlockSize, SlabBlockCount)) {
+      ring.Close(true);
+      return false;
+   }
+   return true;
 #endif
 }
 
@@ -66,207 +78,622 @@ void IPCMessageQueue::CleanupIPC() {
       hSemaphore = NULL;
    }
 #else
-   if (msgId != -1) {
-      msgctl(msgId, IPC_RMID, NULL);
-      msgId = -1;
-   }
+   ring.Close(true);
+   slab.Close(true);
+   ownReply.ring.Close(true);
+   replyRings.clear();
 #endif
 }
 
-void IPCMessageQueue::ProcessMessages() {
+void IPCMessageQueue::ProcessMessages(const std::atomic<bool>& active) {
+#ifdef _WIN32
    SharedMessage msg;
 
-   while (running) {
-#ifdef _WIN32
+   while (active) {
       DWORD waitResult = WaitForSingleObject(hSemaphore, 100);
       if (waitResult == WAIT_OBJECT_0) {
          WaitForSingleObject(hMutex, INFINITE);
          LPVOID pBuf = MapViewOfFile(hMapFile, FILE_MAP_READ, 0, 0, sizeof(SharedMessage));
 
          if (pBuf) {
-            memcpy(&msg, pBuf, sizeof(SharedMessage));
+            const SharedMessage* shared = static_cast<const SharedMessage*>(pBuf);
+            memcpy(&msg, shared, offsetof(SharedMessage, data));
+            memcpy(msg.data, shared->data, msg.dataSize < sizeof(msg.data) ? msg.dataSize : sizeof(msg.data));
             UnmapViewOfFile(pBuf);
 
             ReleaseMutex(hMutex);
 
-            // Deserialize parameters
-            std::stringstream ss(std::string(msg.data, msg.dataSize));
-            std::vector<Parameter> params;
-            size_t paramCount;
-            char delimiter;
-
-            ss >> paramCount >> delimiter;
-
-            for (size_t i = 0; i < paramCount; ++i) {
-               size_t typeHash;
-               char colon;
-               ss >> typeHash >> colon;
-
-               if (typeHash == typeid(int).hash_code()) {
-                  int value;
-                  ss >> value >> delimiter;
-                  params.push_back(value);
-               }
-               else if (typeHash == typeid(float).hash_code()) {
-                  float value;
-                  ss >> value >> delimiter;
-                  params.push_back(value);
-               }
-               else if (typeHash == typeid(double).hash_code()) {
-                  double value;
-                  ss >> value >> delimiter;
-                  params.push_back(value);
-               }
-               else if (typeHash == typeid(std::string).hash_code()) {
-                  std::string value;
-                  std::getline(ss, value, ';');
-                  params.push_back(value);
+            const unsigned char* body = reinterpret_cast<const unsigned char*>(msg.data);
+            if (msg.type == 2) {
+               MessagePayload payload;
+               if (handlers.DecodePayload(msg.id, body, msg.dataSize, payload)) {
+                  handlers.DispatchPayload(msg.id, payload);
                }
+               continue;
             }
-
-            // Process message
-            std::lock_guard<std::mutex> lock(handlerMutex);
-            auto it = handlers.find(msg.id);
-            if (it != handlers.end()) {
-               for (const auto& handler : it->second) {
-                  try {
-                     handler(params);
-                  }
-                  catch (const std::exception& e) {
-                     // Handle exception (log error, etc.)
-                  }
-               }
+            ParameterPack params;
+            if (ParameterCodec::Decode(body, msg.dataSize, params)) {
+               // Process message (lock-free handler snapshot)
+               handlers.Dispatch(msg.id, params);
             }
          }
       }
+   }
 #else
-      if (msgrcv(msgId, &msg, sizeof(SharedMessage) - sizeof(long), 0, IPC_NOWAIT) != -1) {
-         // Deserialize and process message (same as Windows version)
-         std::stringstream ss(std::string(msg.data, msg.dataSize));
-         std::vector<Parameter> params;
-         size_t paramCount;
-         char delimiter;
-
-         ss >> paramCount >> delimiter;
-
-         for (size_t i = 0; i < paramCount; ++i) {
-            size_t typeHash;
-            char colon;
-            ss >> typeHash >> colon;
-
-            if (typeHash == typeid(int).hash_code()) {
-               int value;
-               ss >> value >> delimiter;
-               params.push_back(value);
-            }
-            else if (typeHash == typeid(float).hash_code()) {
-               float value;
-               ss >> value >> delimiter;
-               params.push_back(value);
-            }
-            else if (typeHash == typeid(double).hash_code()) {
-               double value;
-               ss >> value >> delimiter;
-               params.push_back(value);
-            }
-            else if (typeHash == typeid(std::string).hash_code()) {
-               std::string value;
-               std::getline(ss, value, ';');
-               params.push_back(value);
-            }
+   // Pop blocks on the ring's futex until a message arrives or Stop() wakes us;
+   // whatever else is already queued is drained without blocking, up to batchSize
+   std::vector<Received> drained;
+   HandlerRegistry::Run run;
+   auto consume = [this, &drained](int32_t tag, const unsigned char* data, size_t size) {
+      Received msg;
+      msg.id = tag;
+      if (size > 0 && (data[0] & FrameTyped) != 0) {
+         // Decoded by the receiving handler's definition; dropped if there is none
+         const unsigned char* body;
+         size_t bodySize;
+         SharedBuffer slabFrame;
+         if (FrameBody(data, size, 0, body, bodySize, slabFrame)
+            && handlers.DecodePayload(msg.id, body, bodySize, msg.payload)) {
+            drained.push_back(std::move(msg));
          }
+         return;
+      }
+      bool isRequest = size > 0 && (data[0] & FrameRequest) != 0;
+      if (!ReadFrame(data, size, isRequest ? sizeof(RequestHeader) : 0, msg.params)) {
+         return;
+      }
+      if (isRequest) {
+         RequestHeader request;
+         memcpy(&request, data + 1, sizeof(request));
+         msg.correlation = request.correlation;
+         msg.replyPid = request.replyPid;
+      }
+      drained.push_back(std::move(msg));
+   };
 
-         // Process message
-         std::lock_guard<std::mutex> lock(handlerMutex);
-         auto it = handlers.find(msg.id);
-         if (it != handlers.end()) {
-            for (const auto& handler : it->second) {
-               try {
-                  handler(params);
-               }
-               catch (const std::exception& e) {
-                  // Handle exception (log error, etc.)
-               }
-            }
-         }
+   while (ring.Pop(consume, active)) {
+      size_t limit = batchSize.load(std::memory_order_relaxed);
+      for (size_t taken = 1; taken < limit && ring.TryPop(consume); ++taken) {
       }
-      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+      // Process messages outside the slots so producers can reuse them immediately
+      handlers.DispatchDrained(drained, run, [this](Received& msg) {
+         RequestHeader request{};
+         request.correlation = msg.correlation;
+         request.replyPid = msg.replyPid;
+         SendReply(request, msg.id, msg.params);
+         });
+      drained.clear();
+   }
 #endif
+}
+
+#ifndef _WIN32
+// Locates the body of a frame written by SendBody, skipping prefixSize bytes after the kind
+// byte. A slab body is read in place; slabFrame holds its reference until the caller is done.
+bool IPCMessageQueue::FrameBody(const unsigned char* data, size_t size, size_t prefixSize,
+   const unsigned char*& body, size_t& bodySize, SharedBuffer& slabFrame) {
+   size_t head = 1 + prefixSize;
+   if (size < head) {
+      return false;
    }
+   uint8_t kind = data[0] & FrameBodyMask;
+   if (kind == FrameInline) {
+      body = data + head;
+      bodySize = size - head;
+      return true;
+   }
+   if (kind == FrameSlab && size == head + 2 * sizeof(uint64_t)) {
+      uint64_t handle, length;
+      memcpy(&handle, data + head, sizeof(handle));
+      memcpy(&length, data + head + sizeof(handle), sizeof(length));
+      slabFrame = slab.Pool()->Adopt(handle, static_cast<size_t>(length));
+      body = slabFrame.Data();
+      bodySize = slabFrame.Size();
+      return bodySize == length;
+   }
+   return false;
+}
+
+// Decodes a frame written by SendFrame, skipping prefixSize bytes after the kind byte
+bool IPCMessageQueue::ReadFrame(const unsigned char* data, size_t size, size_t prefixSize, ParameterPack& params) {
+   const unsigned char* body;
+   size_t bodySize;
+   SharedBuffer slabFrame; // the frame's slab reference drops at scope exit
+   return FrameBody(data, size, prefixSize, body, bodySize, slabFrame)
+      && ParameterCodec::Decode(body, bodySize, params, slab.Pool());
 }
 
+// Serves a request on this worker and sends the reply to the requester's reply ring
+void IPCMessageQueue::SendReply(const RequestHeader& request, MessageId id, const ParameterPack& params) {
+   int32_t status = ReplyOk;
+   Reply reply;
+   try {
+      reply = handlers.Serve(id, params);
+   }
+   catch (const std::exception& e) {
+      status = ReplyFailed;
+      reply = { Parameter(std::string(e.what())) };
+   }
+   catch (...) {
+      status = ReplyFailed;
+      reply = { Parameter(std::string("Request handler failed")) };
+   }
+
+   std::shared_ptr<ReplyTarget> target = ReplyRingFor(request.replyPid);
+   if (!target) {
+      return; // requester is gone; nobody is waiting for the reply
+   }
+
+   // Bounded: a requester that stopped reading (or crashed with a full ring) must not stall
+   // this worker. A dropped reply surfaces as a timeout on the requester's side.
+   auto deadline = SharedMemoryRing::Clock::now();
+   if (!target->stalled.load(std::memory_order_relaxed)) {
+      deadline += std::chrono::milliseconds(ReplyWaitMs);
+   }
+   bool sent;
+   try {
+      StageBuffers(reply);
+      sent = SendFrame(target->ring, status, 0, &request.correlation, sizeof(request.correlation), reply, deadline);
+   }
+   catch (const std::exception& e) {
+      // The reply could not be encoded (e.g. slab exhausted): fail the request instead
+      Reply error{ Parameter(std::string(e.what())) };
+      sent = SendFrame(target->ring, ReplyFailed, 0, &request.correlation, sizeof(request.correlation), error, deadline);
+   }
+   target->stalled.store(!sent, std::memory_order_relaxed);
+}
+
+namespace {
+   // kill(pid, 0) checks for existence without sending anything
+   bool ProcessAlive(int32_t pid) {
+      return kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+   }
+}
+
+// A cached ring is used only while its requester is alive and has not retired it; a pid
+// reused by a new requester then maps that process's own ring, not the old one
+std::shared_ptr<IPCMessageQueue::ReplyTarget> IPCMessageQueue::ReplyRingFor(int32_t pid) {
+   std::lock_guard<std::mutex> lock(replyMutex);
+   if (pid == static_cast<int32_t>(getpid())) {
+      // Non-owning: ownReply is a member
+      return ownReply.ring.IsOpen() ? std::shared_ptr<ReplyTarget>(std::shared_ptr<void>(), &ownReply) : nullptr;
+   }
+   auto it = replyRings.find(pid);
+   if (it != replyRings.end()) {
+      if (!it->second->ring.IsRetired() && ProcessAlive(pid)) {
+         return it->second;
+      }
+      replyRings.erase(it);
+   }
+   if (!ProcessAlive(pid)) {
+      return nullptr;
+   }
+
+   // Opening a new ring is rare: forget the rings of every other requester that went away
+   for (auto stale = replyRings.begin(); stale != replyRings.end();) {
+      if (stale->second->ring.IsRetired() || !ProcessAlive(stale->first)) {
+         stale = replyRings.erase(stale);
+      }
+      else {
+         ++stale;
+      }
+   }
+
+   // Attach only: a ring that no longer exists belongs to a process that has exited
+   auto target = std::make_shared<ReplyTarget>();
+   if (!target->ring.Open(queueName + ".reply." + std::to_string(pid), ReplySlotCount, sizeof(SharedMessage::data), true)
+      || target->ring.IsRetired()) {
+      return nullptr;
+   }
+   replyRings.emplace(pid, target);
+   return target;
+}
+
+bool IPCMessageQueue::OpenReplyChannel() {
+   std::lock_guard<std::mutex> lock(replyMutex);
+   if (ownReply.ring.IsOpen()) {
+      return true;
+   }
+   if (!running) {
+      return false;
+   }
+   // A ring still under our name was left by an earlier process with this pid: retire it so
+   // servers that cached it let go, and start from a fresh one
+   std::string name = queueName + ".reply." + std::to_string(getpid());
+   SharedMemoryRing::Retire(name, ReplySlotCount, sizeof(SharedMessage::data));
+   if (!ownReply.ring.Open(name, ReplySlotCount, sizeof(SharedMessage::data))) {
+      return false;
+   }
+   replyThread = std::make_unique<std::thread>(&IPCMessageQueue::ProcessReplies, this);
+   return true;
+}
+
+void IPCMessageQueue::ProcessReplies() {
+   int32_t status = ReplyOk;
+   uint64_t correlation = 0;
+   bool valid = false;
+   Reply reply;
+   auto consume = [this, &status, &correlation, &valid, &reply](int32_t tag, const unsigned char* data, size_t size) {
+      status = tag;
+      valid = ReadFrame(data, size, sizeof(correlation), reply);
+      if (valid) {
+         memcpy(&correlation, data + 1, sizeof(correlation));
+      }
+   };
+
+   while (ownReply.ring.Pop(consume, running)) {
+      if (!valid) {
+         continue;
+      }
+      if (status == ReplyOk) {
+         pending.Complete(correlation, std::move(reply));
+      }
+      else {
+         const std::string* message = reply.empty() ? nullptr : std::get_if<std::string>(&reply[0]);
+         pending.Fail(correlation, std::make_exception_ptr(RequestFailedException(message ? *message : "Request failed")));
+      }
+      reply.clear();
+   }
+}
+#endif
+
 void IPCMessageQueue::Start() {
+   std::lock_guard<std::mutex> resize(resizeMutex);
    if (!running) {
       if (!InitializeIPC()) {
          throw std::runtime_error("Failed to initialize IPC");
       }
 
       running = true;
-      for (size_t i = 0; i < threadCount; ++i) {
-         workerThreads.push_back(
-            std::make_unique<std::thread>(&IPCMessageQueue::ProcessMessages, this)
-         );
-      }
+      ResizeWorkers(threadCount);
    }
 }
 
 void IPCMessageQueue::Stop() {
+   std::lock_guard<std::mutex> resize(resizeMutex);
    if (running) {
       running = false;
-      for (auto& thread : workerThreads) {
-         if (thread && thread->joinable()) {
-            thread->join();
+      for (auto& worker : workers) {
+         worker->active = false;
+      }
+#ifndef _WIN32
+      ring.WakeAll();
+      {
+         std::lock_guard<std::mutex> lock(replyMutex);
+         if (ownReply.ring.IsOpen()) {
+            ownReply.ring.WakeAll();
          }
       }
-      workerThreads.clear();
+      if (replyThread && replyThread->joinable()) {
+         replyThread->join();
+      }
+      replyThread.reset();
+#endif
+      for (auto& worker : workers) {
+         if (worker->thread->joinable()) {
+            worker->thread->join();
+         }
+      }
+      workers.clear();
+      handlers.WaitForFanOuts(); // handlers the workers fanned out to an executor
       CleanupIPC();
    }
 }
 
 void IPCMessageQueue::SetThreadCount(size_t numThreads) {
+   std::lock_guard<std::mutex> resize(resizeMutex);
    if (running) {
-      Stop();
+      ResizeWorkers(numThreads);
    }
    threadCount = numThreads;
 }
 
+void IPCMessageQueue::SetWorkerPlacement(const WorkerPlacement& workerPlacement) {
+   std::lock_guard<std::mutex> resize(resizeMutex);
+   placement = workerPlacement;
+   for (size_t i = 0; i < workers.size(); ++i) {
+      placement.Apply(*workers[i]->thread, i);
+   }
+}
+
+// Called with resizeMutex held while running. A retired worker finishes its current batch;
+// messages still in the ring are left to the remaining workers (or to other processes).
+void IPCMessageQueue::ResizeWorkers(size_t count) {
+   while (workers.size() < count) {
+      auto worker = std::make_unique<Worker>();
+      worker->thread = std::make_unique<std::thread>(&IPCMessageQueue::ProcessMessages, this, std::cref(worker->active));
+      if (!placement.Empty()) {
+         placement.Apply(*worker->thread, workers.size());
+      }
+      workers.push_back(std::move(worker));
+   }
+   if (workers.size() > count) {
+      for (size_t i = count; i < workers.size(); ++i) {
+         workers[i]->active = false;
+      }
+#ifndef _WIN32
+      // Waiters that are not retiring see their flag still set and wait again
+      ring.WakeAll();
+#endif
+      for (size_t i = count; i < workers.size(); ++i) {
+         workers[i]->thread->join();
+      }
+      workers.resize(count);
+   }
+}
+
+void IPCMessageQueue::EnableMetrics(bool enabled) {
+   metrics.Enable(enabled);
+}
+
+MetricsSnapshot IPCMessageQueue::SnapshotMetrics() const {
+   return metrics.Snapshot();
+}
+
+// The sending side's counts; a message that could not be sent counts as dropped
+void IPCMessageQueue::Sending(MessageId id) {
+   if (metrics.Enabled()) {
+      metrics.Enqueued(id);
+   }
+}
+
+void IPCMessageQueue::SendFailed(MessageId id) {
+   if (metrics.Enabled()) {
+      metrics.Dropped(id);
+   }
+}
+
 void IPCMessageQueue::RegisterHandler(MessageId id, MessageHandler handler) {
-   std::lock_guard<std::mutex> lock(handlerMutex);
-   handlers[id].push_back(handler);
+   handlers.Add(id, std::move(handler));
+}
+
+void IPCMessageQueue::RegisterRequestHandler(MessageId id, RequestHandler handler) {
+   handlers.AddRequestHandler(id, std::move(handler));
+}
+
+void IPCMessageQueue::RegisterBatchHandler(MessageId id, BatchHandler handler) {
+   handlers.AddBatch(id, std::move(handler));
+}
+
+void IPCMessageQueue::RegisterPayloadHandler(MessageId id, PayloadHandler handler) {
+   handlers.AddPayload(id, std::move(handler));
+}
+
+void IPCMessageQueue::SetFanOut(MessageId id, bool parallel, JoinHandler onJoin, std::shared_ptr<IExecutor> executor) {
+   handlers.SetFanOut(id, parallel, std::move(onJoin), std::move(executor));
+}
+
+void IPCMessageQueue::SetBatchSize(size_t maxMessages) {
+   batchSize.store(maxMessages == 0 ? 1 : maxMessages, std::memory_order_relaxed);
+}
+
+SharedBuffer IPCMessageQueue::CreateBuffer(const void* data, size_t size) {
+#ifndef _WIN32
+   if (slab.IsOpen()) {
+      SharedBuffer buffer = slab.Create(data, size);
+      if (buffer.Size() == size) {
+         return buffer;
+      }
+   }
+#endif
+   return SharedBuffer(data, size);
 }
 
-void IPCMessageQueue::QueueMessageImpl(MessageId id, const std::vector<Parameter>& params) {
+void IPCMessageQueue::QueueMessageImpl(MessageId id, ParameterPack&& params) {
+   Sending(id);
+#ifdef _WIN32
    SharedMessage msg;
    msg.type = 1;
    msg.id = id;
+   msg.dataSize = ParameterCodec::Encode(params, reinterpret_cast<unsigned char*>(msg.data), sizeof(msg.data));
 
-   std::stringstream ss;
-   ss << params.size() << ";";
+   if (hMapFile && hMutex && hSemaphore) {
+      WaitForSingleObject(hMutex, INFINITE);
+      LPVOID pBuf = MapViewOfFile(hMapFile, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(SharedMessage));
+      if (pBuf) {
+         memcpy(pBuf, &msg, offsetof(SharedMessage, data) + msg.dataSize);
+         UnmapViewOfFile(pBuf);
+         ReleaseSemaphore(hSemaphore, 1, NULL);
+      }
+      else {
+         SendFailed(id);
+      }
+      ReleaseMutex(hMutex);
+   }
+   else {
+      SendFailed(id);
+   }
+#else
+   if (!ring.IsOpen()) {
+      SendFailed(id);
+      return;
+   }
 
-   for (const auto& param : params) {
-      std::visit([&ss](const auto& value) {
-         ss << typeid(value).hash_code() << ":" << value << ";";
-         }, param);
+   try {
+      StageBuffers(params);
+      if (!SendFrame(ring, id, 0, nullptr, 0, params)) {
+         SendFailed(id);
+      }
+   }
+   catch (...) {
+      SendFailed(id);
+      throw;
    }
+#endif
+}
 
-   std::string serialized = ss.str();
-   msg.dataSize = serialized.size();
-   memcpy(msg.data, serialized.c_str(), serialized.size());
+IPCMessageQueue::ReplyFuture IPCMessageQueue::RequestImpl(MessageId id, ParameterPack&& params,
+   std::chrono::milliseconds timeout) {
+   ReplyFuture future;
+   uint64_t correlation = pending.Add(timeout, future);
+   Sending(id);
+#ifdef _WIN32
+   SendFailed(id);
+   pending.Fail(correlation, std::make_exception_ptr(
+      RequestFailedException("Request/reply is not supported by the Windows IPC transport")));
+#else
+   try {
+      if (!ring.IsOpen() || !OpenReplyChannel()) {
+         throw RequestFailedException("IPC queue is not running");
+      }
+      RequestHeader request{};
+      request.correlation = correlation;
+      request.replyPid = static_cast<int32_t>(getpid());
 
+      StageBuffers(params);
+      if (!SendFrame(ring, id, FrameRequest, &request, sizeof(request), params)) {
+         throw RequestFailedException("IPC queue stopped");
+      }
+   }
+   catch (...) {
+      SendFailed(id);
+      pending.Fail(correlation, std::current_exception());
+   }
+#endif
+   return future;
+}
+
+void IPCMessageQueue::QueuePayloadImpl(MessageId id, MessagePayload&& payload) {
+   size_t size = payload.EncodedSize();
+   Sending(id);
 #ifdef _WIN32
+   SharedMessage msg;
+   if (size > sizeof(msg.data)) {
+      SendFailed(id);
+      return;
+   }
+   msg.type = 2;
+   msg.id = id;
+   msg.dataSize = size;
+   payload.Encode(reinterpret_cast<unsigned char*>(msg.data));
+
    if (hMapFile && hMutex && hSemaphore) {
       WaitForSingleObject(hMutex, INFINITE);
       LPVOID pBuf = MapViewOfFile(hMapFile, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(SharedMessage));
       if (pBuf) {
-         memcpy(pBuf, &msg, sizeof(SharedMessage));
+         memcpy(pBuf, &msg, offsetof(SharedMessage, data) + msg.dataSize);
          UnmapViewOfFile(pBuf);
          ReleaseSemaphore(hSemaphore, 1, NULL);
       }
+      else {
+         SendFailed(id);
+      }
       ReleaseMutex(hMutex);
    }
+   else {
+      SendFailed(id);
+   }
 #else
-   if (msgId != -1) {
-      msgsnd(msgId, &msg, sizeof(SharedMessage) - sizeof(long), 0);
+   if (!ring.IsOpen()) {
+      SendFailed(id);
+      return;
+   }
+
+   try {
+      bool sent = SendBody(ring, id, FrameTyped, nullptr, 0, size, [&payload](unsigned char* dst) {
+         payload.Encode(dst);
+         }, [] {});
+      if (!sent) {
+         SendFailed(id);
+      }
+   }
+   catch (...) {
+      SendFailed(id);
+      throw;
    }
 #endif
 }
+
+#ifndef _WIN32
+// Large heap buffers are moved into the slab once so the receiver maps them instead of
+// copying; buffers the caller already created with CreateBuffer() cross as handles as-is.
+// The pack belongs to the message being sent, so the buffers are swapped in place.
+void IPCMessageQueue::StageBuffers(ParameterPack& params) {
+   for (Parameter& param : params) {
+      SharedBuffer* buffer = std::get_if<SharedBuffer>(&param);
+      if (!buffer || buffer->Pool() == slab.Pool() || buffer->Size() <= InlineBufferLimit) {
+         continue;
+      }
+      SharedBuffer pooled = slab.Create(buffer->Data(), buffer->Size());
+      if (pooled.Size() != buffer->Size()) {
+         continue; // slab exhausted: send inline
+      }
+      *buffer = std::move(pooled);
+   }
+}
+
+// Frame layout: [u8 kind | flags][prefix][body, or slab handle + length], where encode
+// writes the size bytes of the body. Returns false if the queue stopped or deadline passed
+// before a slot became free, or the target ring was retired. encode must not throw when the body fits a ring slot (the slot is already
+// claimed), so callers validate first. discard() drops whatever encode handed to the
+// receiver (e.g. buffer references) when an encoded body is never delivered.
+template<typename Encode, typename Discard>
+bool IPCMessageQueue::SendBody(SharedMemoryRing& target, int32_t tag, uint8_t flags, const void* prefix, size_t prefixSize,
+   size_t size, Encode&& encode, Discard&& discard, SharedMemoryRing::Clock::time_point deadline) {
+   size_t head = 1 + prefixSize;
+
+   if (head + size <= target.MaxPayloadSize()) {
+      // Small message: encoded straight into the shared slot, only its actual size
+      return target.Emplace(tag, head + size, [&encode, flags, prefix, prefixSize, head](unsigned char* dst) {
+         dst[0] = FrameInline | flags;
+         if (prefixSize > 0) {
+            memcpy(dst + 1, prefix, prefixSize);
+         }
+         encode(dst + head);
+         }, running, deadline);
+   }
+
+   // Too big for a slot: encode into a slab allocation and pass only its handle.
+   // The allocation's initial reference travels with the message.
+   // When the slab is momentarily full, wait (bounded) for receivers to drop buffers
+   uint64_t handle = slab.Allocate(size);
+   for (int retry = 0; handle == 0 && running && retry < SlabWaitMs; ++retry) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      handle = slab.Allocate(size);
+   }
+   if (handle == 0) {
+      throw std::length_error("IPCMessageQueue: message exceeds free shared-memory slab space");
+   }
+   try {
+      encode(slab.Data(handle));
+   }
+   catch (...) {
+      slab.Release(handle);
+      throw;
+   }
+
+   uint64_t length = size;
+   bool sent = target.Emplace(tag, head + 2 * sizeof(uint64_t), [handle, length, flags, prefix, prefixSize, head](unsigned char* dst) {
+      dst[0] = FrameSlab | flags;
+      if (prefixSize > 0) {
+         memcpy(dst + 1, prefix, prefixSize);
+      }
+      memcpy(dst + head, &handle, sizeof(handle));
+      memcpy(dst + head + sizeof(handle), &length, sizeof(length));
+      }, running, deadline);
+   if (!sent) {
+      discard();
+      slab.Release(handle);
+   }
+   return sent;
+}
+
+bool IPCMessageQueue::SendFrame(SharedMemoryRing& target, int32_t tag, uint8_t flags, const void* prefix, size_t prefixSize,
+   const ParameterPack& params, SharedMemoryRing::Clock::time_point deadline) {
+   ISharedBufferPool* pool = slab.Pool();
+   ParameterCodec::Validate(params, pool); // before any slab block or ring slot is taken
+   size_t size = ParameterCodec::EncodedSize(params, pool);
+   return SendBody(target, tag, flags, prefix, prefixSize, size, [&params, size, pool](unsigned char* dst) {
+      ParameterCodec::Encode(params, dst, size, pool);
+      }, [this, &params, pool] {
+         // Encode retained every slab buffer once for the receiver that will never see it
+         for (const Parameter& param : params) {
+            const SharedBuffer* buffer = std::get_if<SharedBuffer>(&param);
+            if (buffer && pool && buffer->Pool() == pool) {
+               slab.Release(buffer->Handle());
+            }
+         }
+      }, deadline);
+}
+#endif
\ No newline at end of file
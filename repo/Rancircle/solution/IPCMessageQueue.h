@@ -1,18 +1,19 @@
 #pragma once
 #include "messageQueue.h"
+#include "HandlerRegistry.h"
+#include "PendingRequestTable.h"
 #include <queue>
 #include <map>
 #include <mutex>
+#include <atomic>
 #include <thread>
 #include <condition_variable>
 
 #ifdef _WIN32
 #include <windows.h>
 #else
-#include <sys/ipc.h>
-#include <sys/msg.h>
-#include <fcntl.h>
-#include <sys/stat.h>
+#include "SharedMemoryRing.h"
+#include "SharedMemorySlab.h"
 #endif
 
 class IPCMessageQueue : public IMessageQueue {
@@ -23,35 +24,139 @@ public:
 
    void Start() override;
    void Stop() override;
+   // Adds or retires workers while running; the shared-memory queue and the messages in
+   // it are left alone. Must not be called from a handler.
    void SetThreadCount(size_t numThreads) override;
    void RegisterHandler(MessageId id, MessageHandler handler) override;
+   void RegisterRequestHandler(MessageId id, RequestHandler handler) override;
+   void RegisterBatchHandler(MessageId id, BatchHandler handler) override;
+   void SetBatchSize(size_t maxMessages) override;
+   // Typed messages cross the queue in their fixed layout; the receiving process decodes
+   // them with the definition its handler was registered with
+   void RegisterPayloadHandler(MessageId id, PayloadHandler handler) override;
+   void SetFanOut(MessageId id, bool parallel, JoinHandler onJoin,
+      std::shared_ptr<IExecutor> executor = nullptr) override;
+   void SetWorkerPlacement(const WorkerPlacement& workerPlacement) override;
+   // Each process counts its own side: messages it queued (and failed to send) and messages
+   // its workers dispatched, so depth is only meaningful summed over all processes. Messages
+   // from other processes carry no enqueue time and record no wait.
+   void EnableMetrics(bool enabled) override;
+   MetricsSnapshot SnapshotMetrics() const override;
+
+   // Copies data into a buffer that crosses the queue by handle (shared-memory slab on
+   // Linux, so receivers read it in place); falls back to a heap buffer when that is
+   // not available. Call after Start().
+   SharedBuffer CreateBuffer(const void* data, size_t size);
 
 protected:
-   void QueueMessageImpl(MessageId id, const std::vector<Parameter>& params) override;
-   void ProcessMessages();
+   void QueueMessageImpl(MessageId id, ParameterPack&& params) override;
+   // Linux only: replies come back on a per-process reply ring; Windows fails the future
+   ReplyFuture RequestImpl(MessageId id, ParameterPack&& params, std::chrono::milliseconds timeout) override;
+   void QueuePayloadImpl(MessageId id, MessagePayload&& payload) override;
+   void ProcessMessages(const std::atomic<bool>& active);
    bool InitializeIPC();
    void CleanupIPC();
 private:
+   // dataSize precedes data so only the used prefix of the record is copied.
+   // type 1: codec-encoded parameters, type 2: typed message in its fixed layout
    struct SharedMessage {
       long type;
       MessageId id;
-      char data[4096];
       size_t dataSize;
+      char data[4096];
+   };
+
+   struct Worker {
+      std::unique_ptr<std::thread> thread;
+      std::atomic<bool> active{ true }; // cleared to retire the worker
    };
 
+   void ResizeWorkers(size_t count);
+   void Sending(MessageId id);
+   void SendFailed(MessageId id);
+
    std::string queueName;
-   std::vector<std::unique_ptr<std::thread>> workerThreads;
-   std::map<MessageId, std::vector<MessageHandler>> handlers;
-   std::mutex handlerMutex;
-   bool running;
+   std::vector<std::unique_ptr<Worker>> workers; // guarded by resizeMutex
+   std::mutex resizeMutex;
+   WorkerPlacement placement; // guarded by resizeMutex
+   MetricsRegistry metrics;
+   HandlerRegistry handlers;
+   PendingRequestTable pending;
+   std::atomic<bool> running;
    size_t threadCount;
+   std::atomic<size_t> batchSize;
 
 #ifdef _WIN32
    HANDLE hMapFile;
    HANDLE hMutex;
    HANDLE hSemaphore;
 #else
-   int msgId;
-   key_t key;
+   // Ring payloads start with a frame kind: inline body bytes, or a slab handle for
+   // messages whose encoding does not fit in a ring slot. FrameRequest marks a request,
+   // whose RequestHeader sits between the kind byte and the body. The body is codec bytes,
+   // or the fixed layout of a typed message when FrameTyped is set.
+   enum FrameKind : uint8_t { FrameInline = 0, FrameSlab = 1, FrameBodyMask = 0x3F, FrameTyped = 0x40, FrameRequest = 0x80 };
+
+   // The correlation id and the requester's reply ring "<name>.reply.<pid>"
+   struct RequestHeader {
+      uint64_t correlation;
+      int32_t replyPid;
+      uint32_t reserved;
+   };
+
+   // Reply ring tags. A reply frame carries the correlation id after the kind byte; a failed
+   // reply's body is the error message as a single string parameter.
+   enum ReplyStatus : int32_t { ReplyOk = 0, ReplyFailed = 1 };
+
+   // A decoded ring message waiting in a worker's drained batch
+   struct Received {
+      MessageId id;
+      ParameterPack params;
+      uint64_t correlation = 0; // non-zero for requests
+      int32_t replyPid = 0;
+      MessagePayload payload;   // typed messages only
+      MetricsRegistry::Clock::time_point enqueuedAt; // not known across processes
+   };
+
+   static constexpr uint32_t RingSlotCount = 256;
+   static constexpr uint32_t SlabBlockSize = 64 * 1024;
+   static constexpr uint32_t SlabBlockCount = 512;     // 32 MiB of large-payload space
+   static constexpr size_t InlineBufferLimit = 1024;   // larger SharedBuffers go to the slab
+   static constexpr int SlabWaitMs = 1000;
+   static constexpr uint32_t ReplySlotCount = 64;
+   static constexpr int ReplyWaitMs = 100;             // a reply that finds no room by then is dropped
+
+   void StageBuffers(ParameterPack& params);
+   template<typename Encode, typename Discard>
+   bool SendBody(SharedMemoryRing& target, int32_t tag, uint8_t flags, const void* prefix, size_t prefixSize,
+      size_t size, Encode&& encode, Discard&& discard,
+      SharedMemoryRing::Clock::time_point deadline = SharedMemoryRing::Clock::time_point::max());
+   bool SendFrame(SharedMemoryRing& target, int32_t tag, uint8_t flags, const void* prefix, size_t prefixSize,
+      const ParameterPack& params, SharedMemoryRing::Clock::time_point deadline = SharedMemoryRing::Clock::time_point::max());
+   bool FrameBody(const unsigned char* data, size_t size, size_t prefixSize,
+      const unsigned char*& body, size_t& bodySize, SharedBuffer& slabFrame);
+   bool ReadFrame(const unsigned char* data, size_t size, size_t prefixSize, ParameterPack& params);
+   bool OpenReplyChannel();
+   // A requester's reply ring. Stalled after a reply found no room in time, so later replies
+   // to a requester that stopped reading do not wait again until one gets through.
+   struct ReplyTarget {
+      SharedMemoryRing ring;
+      std::atomic<bool> stalled{ false };
+   };
+
+   std::shared_ptr<ReplyTarget> ReplyRingFor(int32_t pid);
+   void SendReply(const RequestHeader& request, MessageId id, const ParameterPack& params);
+   void ProcessReplies();
+
+   SharedMemoryRing ring;
+   SharedMemorySlab slab;
+
+   // This process's reply ring (opened by the first Request) and the reply rings of the
+   // processes whose requests our workers answer. Rings of requesters that exited (or
+   // retired their ring) are evicted; a worker sending a reply keeps its ring alive.
+   std::mutex replyMutex;
+   ReplyTarget ownReply;
+   std::unique_ptr<std::thread> replyThread;
+   std::map<int32_t, std::shared_ptr<ReplyTarget>> replyRings;
 #endif
 };
\ No newline at end of file
@@ -1,8 +1,16 @@
 #include "LocalMessageQueue.h"
+#include <algorithm>
 
-LocalMessageQueue::LocalMessageQueue(size_t numThreads)
-   : running(false), threadCount(numThreads)
+namespace {
+   const size_t NoShard = static_cast<size_t>(-1);
+}
+
+LocalMessageQueue::LocalMessageQueue(size_t numThreads, size_t keyShards)
+   : queuedCount(0), pushedCount(0), takenCount(0), shards(keyShards == 0 ? 1 : keyShards), shardTurn(false),
+     expired(0), running(false), threadCount(numThreads), batchSize(DefaultBatchSize), busyNanos(0),
+     autoscaleStop(false)
 {
+   handlers.SetMetrics(&metrics);
 }
 
 LocalMessageQueue::~LocalMessageQueue() {
@@ -10,17 +18,17 @@ LocalMessageQueue::~LocalMessageQueue() {
 }
 
 void LocalMessageQueue::Start() {
+   std::lock_guard<std::mutex> resize(resizeMutex);
    if (!running) {
       running = true;
-      for (size_t i = 0; i < threadCount; ++i) {
-         workerThreads.push_back(
-            std::make_unique<std::thread>(&LocalMessageQueue::ProcessMessages, this)
-         );
-      }
+      ResizeWorkers(threadCount);
+      StartAutoscaler();
    }
 }
 
 void LocalMessageQueue::Stop() {
+   StopAutoscaler();
+   std::lock_guard<std::mutex> resize(resizeMutex);
    if (running) {
       {
          std::lock_guard<std::mutex> lock(queueMutex);
@@ -28,65 +36,462 @@ void LocalMessageQueue::Stop() {
       }
       condition.notify_all();
 
-      for (auto& thread : workerThreads) {
-         if (thread && thread->joinable()) {
-            thread->join();
+      for (auto& worker : workers) {
+         if (worker->thread->joinable()) {
+            worker->thread->join();
          }
       }
-      workerThreads.clear();
+      workers.clear();
+      handlers.WaitForFanOuts(); // handlers the workers fanned out to an executor
    }
 }
 
 void LocalMessageQueue::SetThreadCount(size_t numThreads) {
+   std::lock_guard<std::mutex> resize(resizeMutex);
    if (running) {
-      Stop();
+      ResizeWorkers(numThreads);
    }
    threadCount = numThreads;
 }
 
+size_t LocalMessageQueue::ThreadCount() {
+   std::lock_guard<std::mutex> resize(resizeMutex);
+   return running ? workers.size() : threadCount;
+}
+
+void LocalMessageQueue::SetWorkerPlacement(const WorkerPlacement& workerPlacement) {
+   std::lock_guard<std::mutex> resize(resizeMutex);
+   placement = workerPlacement;
+   for (size_t i = 0; i < workers.size(); ++i) {
+      placement.Apply(*workers[i]->thread, i);
+   }
+}
+
+// Called with resizeMutex held while running. New workers start right away; the newest
+// workers are retired and joined once they finish the batch they are dispatching.
+void LocalMessageQueue::ResizeWorkers(size_t count) {
+   while (workers.size() < count) {
+      auto worker = std::make_unique<Worker>();
+      worker->thread = std::make_unique<std::thread>(&LocalMessageQueue::ProcessMessages, this, std::cref(worker->retire));
+      if (!placement.Empty()) {
+         placement.Apply(*worker->thread, workers.size());
+      }
+      workers.push_back(std::move(worker));
+   }
+   if (workers.size() > count) {
+      {
+         std::lock_guard<std::mutex> lock(queueMutex);
+         for (size_t i = count; i < workers.size(); ++i) {
+            workers[i]->retire = true;
+         }
+      }
+      // Also wakes the remaining workers, which go back to sleep if there is no work
+      condition.notify_all();
+      for (size_t i = count; i < workers.size(); ++i) {
+         workers[i]->thread->join();
+      }
+      workers.resize(count);
+   }
+   threadCount = count;
+}
+
+void LocalMessageQueue::EnableMetrics(bool enabled) {
+   metrics.Enable(enabled);
+}
+
+MetricsSnapshot LocalMessageQueue::SnapshotMetrics() const {
+   return metrics.Snapshot();
+}
+
+void LocalMessageQueue::SetAutoscale(const AutoscalePolicy& policy) {
+   StopAutoscaler();
+   {
+      std::lock_guard<std::mutex> lock(autoscaleMutex);
+      autoscale = policy;
+   }
+   std::lock_guard<std::mutex> resize(resizeMutex);
+   if (running) {
+      StartAutoscaler();
+   }
+}
+
+// Called with resizeMutex held while running
+void LocalMessageQueue::StartAutoscaler() {
+   std::lock_guard<std::mutex> lock(autoscaleMutex);
+   if (autoscale.maxThreads > 0 && !autoscaleThread) {
+      autoscaleStop = false;
+      autoscaleThread = std::make_unique<std::thread>(&LocalMessageQueue::Autoscale, this);
+   }
+}
+
+void LocalMessageQueue::StopAutoscaler() {
+   std::unique_ptr<std::thread> thread;
+   {
+      std::lock_guard<std::mutex> lock(autoscaleMutex);
+      autoscaleStop = true;
+      thread = std::move(autoscaleThread);
+   }
+   autoscaleCondition.notify_all();
+   if (thread && thread->joinable()) {
+      thread->join();
+   }
+}
+
+void LocalMessageQueue::Autoscale() {
+   size_t quiet = 0;
+   uint64_t lastBusy = busyNanos.load();
+   Clock::time_point lastSample = Clock::now();
+   std::unique_lock<std::mutex> lock(autoscaleMutex);
+   while (!autoscaleStop) {
+      AutoscalePolicy policy = autoscale;
+      auto interval = std::max(policy.interval, std::chrono::milliseconds(1));
+      if (autoscaleCondition.wait_for(lock, interval, [this] { return autoscaleStop; })) {
+         break;
+      }
+      lock.unlock();
+
+      uint64_t backlog;
+      {
+         std::lock_guard<std::mutex> queueLock(queueMutex);
+         backlog = pushedCount - takenCount;
+      }
+      Clock::time_point now = Clock::now();
+      uint64_t busy = busyNanos.load();
+      {
+         std::lock_guard<std::mutex> resize(resizeMutex);
+         size_t active = workers.size();
+         double available = std::chrono::duration<double, std::nano>(now - lastSample).count() * std::max<size_t>(active, 1);
+         double busyShare = available > 0 ? (busy - lastBusy) / available : 0.0;
+         lastBusy = busy;
+         lastSample = now;
+
+         size_t minThreads = std::max<size_t>(policy.minThreads, 1);
+         size_t maxThreads = std::max(policy.maxThreads, minThreads);
+         size_t target = active;
+         if (active < minThreads) {
+            target = minThreads;
+         }
+         else if (backlog > policy.backlogPerWorker * active || busyShare > policy.busyHigh) {
+            quiet = 0;
+            target = std::min(maxThreads, active + std::max<size_t>(active / 2, 1));
+         }
+         else if (backlog == 0 && busyShare < policy.busyLow) {
+            if (++quiet >= policy.idleIntervals && active > minThreads) {
+               quiet = 0;
+               target = active - 1;
+            }
+         }
+         else {
+            quiet = 0;
+         }
+         if (running && target != active) {
+            ResizeWorkers(target);
+         }
+      }
+      lock.lock();
+   }
+}
+
 void LocalMessageQueue::RegisterHandler(MessageId id, MessageHandler handler) {
-   std::lock_guard<std::mutex> lock(handlerMutex);
-   handlers[id].push_back(handler);
+   handlers.Add(id, std::move(handler));
+}
+
+void LocalMessageQueue::RegisterRequestHandler(MessageId id, RequestHandler handler) {
+   handlers.AddRequestHandler(id, std::move(handler));
+}
+
+void LocalMessageQueue::RegisterBatchHandler(MessageId id, BatchHandler handler) {
+   handlers.AddBatch(id, std::move(handler));
+}
+
+void LocalMessageQueue::RegisterPayloadHandler(MessageId id, PayloadHandler handler) {
+   handlers.AddPayload(id, std::move(handler));
+}
+
+void LocalMessageQueue::SetFanOut(MessageId id, bool parallel, JoinHandler onJoin, std::shared_ptr<IExecutor> executor) {
+   handlers.SetFanOut(id, parallel, std::move(onJoin), std::move(executor));
+}
+
+void LocalMessageQueue::SetBatchSize(size_t maxMessages) {
+   std::lock_guard<std::mutex> lock(queueMutex);
+   batchSize = maxMessages == 0 ? 1 : maxMessages;
+}
+
+void LocalMessageQueue::SetPriority(MessageId id, MessagePriority priority) {
+   std::lock_guard<std::mutex> lock(queueMutex);
+   priorities[id] = priority;
+}
+
+void LocalMessageQueue::SetExpiredHandler(ExpiredHandler handler) {
+   auto next = handler ? std::make_shared<const ExpiredHandler>(std::move(handler)) : nullptr;
+   std::lock_guard<std::mutex> lock(queueMutex);
+   expiredHandler = std::move(next);
+}
+
+PoolStats LocalMessageQueue::MessagePoolStats() {
+   std::lock_guard<std::mutex> lock(queueMutex);
+   PoolStats stats;
+   stats.acquired = pushedCount;
+   for (const MessageFifo& lane : lanes) {
+      stats.highWaterMark += lane.capacity();
+   }
+   for (const Shard& shard : shards) {
+      stats.highWaterMark += shard.messages.capacity();
+   }
+   // Counts every slot as used fresh once, so reuse is a lower bound
+   stats.reused = pushedCount > stats.highWaterMark ? pushedCount - stats.highWaterMark : 0;
+   return stats;
+}
+
+// Called with queueMutex held
+size_t LocalMessageQueue::LaneFor(MessageId id) const {
+   auto it = priorities.find(id);
+   return static_cast<size_t>(it == priorities.end() ? MessagePriority::Normal : it->second);
 }
 
-void LocalMessageQueue::QueueMessageImpl(MessageId id, const std::vector<Parameter>& params) {
+// Called with queueMutex held and at least one message queued
+size_t LocalMessageQueue::PickLane() const {
+   size_t chosen = LaneCount;
+   for (size_t lane = 0; lane < LaneCount; ++lane) {
+      if (lanes[lane].empty()) {
+         continue;
+      }
+      if (chosen == LaneCount) {
+         chosen = lane;
+      }
+      else if (skipped[lane] >= StarvationLimit) {
+         chosen = lane;
+         break;
+      }
+   }
+   return chosen;
+}
+
+// Called with queueMutex held; moves the front of lane into drained
+void LocalMessageQueue::TakeFrom(size_t lane, std::vector<Message>& drained) {
+   for (size_t other = 0; other < LaneCount; ++other) {
+      if (other != lane && !lanes[other].empty()) {
+         ++skipped[other];
+      }
+   }
+   skipped[lane] = 0;
+   drained.push_back(std::move(lanes[lane].front()));
+   lanes[lane].pop_front();
+   --queuedCount;
+}
+
+// Records msg as queued while metrics are enabled
+void LocalMessageQueue::Stamp(Message& msg) {
+   if (metrics.Enabled()) {
+      msg.enqueuedAt = Clock::now();
+      metrics.Enqueued(msg.id);
+   }
+}
+
+void LocalMessageQueue::Push(Message&& msg) {
+   Stamp(msg);
+   {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      lanes[LaneFor(msg.id)].push_back(std::move(msg));
+      ++queuedCount;
+      ++pushedCount;
+   }
+   condition.notify_one();
+}
+
+void LocalMessageQueue::PushKeyed(uint64_t key, Message&& msg) {
+   // Fibonacci hashing spreads sequential ids over the shards
+   size_t index = static_cast<size_t>(((key * 0x9E3779B97F4A7C15ull) >> 32) % shards.size());
+   bool wake = false;
+   Stamp(msg);
+   {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      Shard& shard = shards[index];
+      shard.messages.push_back(std::move(msg));
+      ++pushedCount;
+      if (!shard.scheduled) {
+         shard.scheduled = true;
+         readyShards.push_back(index);
+         wake = true;
+      }
+   }
+   // A shard that is already scheduled is drained by the worker holding it
+   if (wake) {
+      condition.notify_one();
+   }
+}
+
+void LocalMessageQueue::QueueMessageImpl(MessageId id, ParameterPack&& params) {
+   Push({ id, std::move(params) });
+}
+
+void LocalMessageQueue::QueuePayloadImpl(MessageId id, MessagePayload&& payload) {
+   Message msg{ id };
+   msg.payload = std::move(payload);
+   Push(std::move(msg));
+}
+
+// One lock and one wakeup for the whole batch; a worker that leaves messages behind
+// wakes the next one
+void LocalMessageQueue::QueueMessagesImpl(const BatchMessage* messages, size_t count) {
+   bool recording = metrics.Enabled();
+   Clock::time_point now = recording ? Clock::now() : Clock::time_point();
    {
       std::lock_guard<std::mutex> lock(queueMutex);
-      messageQueue.push({ id, params });
+      for (size_t i = 0; i < count; ++i) {
+         Message msg{ messages[i].id, messages[i].params };
+         msg.enqueuedAt = now;
+         lanes[LaneFor(msg.id)].push_back(std::move(msg));
+      }
+      queuedCount += count;
+      pushedCount += count;
    }
    condition.notify_one();
+   if (recording) {
+      for (size_t i = 0; i < count; ++i) {
+         metrics.Enqueued(messages[i].id);
+      }
+   }
+}
+
+LocalMessageQueue::ReplyFuture LocalMessageQueue::RequestImpl(MessageId id, ParameterPack&& params,
+   std::chrono::milliseconds timeout) {
+   ReplyFuture future;
+   uint64_t correlation = pending.Add(timeout, future);
+   Push({ id, std::move(params), correlation });
+   return future;
+}
+
+// Returns true (after counting it and running the expired handler) if msg missed its deadline
+bool LocalMessageQueue::CheckExpired(const Message& msg, const std::shared_ptr<const ExpiredHandler>& onExpired) {
+   if (msg.deadline >= Clock::now()) {
+      return false;
+   }
+   expired.fetch_add(1, std::memory_order_relaxed);
+   if (metrics.Enabled()) {
+      metrics.Dropped(msg.id);
+   }
+   if (onExpired) {
+      try {
+         (*onExpired)(msg.id, msg.params);
+      }
+      catch (...) {
+         // Nothing may escape the worker thread; count it like a handler failure
+         if (metrics.Enabled()) {
+            metrics.HandlerFailed(msg.id);
+         }
+      }
+   }
+   return true;
+}
+
+// Called with queueMutex held and work available. Takes up to batchSize messages, either
+// from the lanes or from one ready shard, and returns that shard (NoShard for lanes).
+size_t LocalMessageQueue::TakeBatch(std::vector<Message>& drained, bool& hasDeadline) {
+   bool fromShard = false;
+   if (!readyShards.empty()) {
+      if (queuedCount == 0) {
+         fromShard = true;
+      }
+      else if (lanes[static_cast<size_t>(MessagePriority::High)].empty()) {
+         fromShard = shardTurn;
+         shardTurn = !shardTurn;
+      }
+   }
+
+   if (fromShard) {
+      size_t index = readyShards.front();
+      readyShards.pop_front();
+      MessageFifo& messages = shards[index].messages;
+      while (!messages.empty() && drained.size() < batchSize) {
+         drained.push_back(std::move(messages.front()));
+         messages.pop_front();
+      }
+      takenCount += drained.size();
+      return index;
+   }
+
+   // Lane order; a message with a deadline starts a batch of its own
+   while (queuedCount > 0 && drained.size() < batchSize) {
+      size_t lane = PickLane();
+      if (lanes[lane].front().deadline != Clock::time_point::max()) {
+         if (!drained.empty()) {
+            break;
+         }
+         hasDeadline = true;
+      }
+      TakeFrom(lane, drained);
+   }
+   takenCount += drained.size();
+   return NoShard;
+}
+
+// Hands a dispatched shard back: to the end of the ready list if more messages arrived
+void LocalMessageQueue::ReleaseShard(size_t index) {
+   bool wake = false;
+   {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      Shard& shard = shards[index];
+      if (shard.messages.empty()) {
+         shard.scheduled = false;
+      }
+      else {
+         readyShards.push_back(index);
+         wake = true;
+      }
+   }
+   if (wake) {
+      condition.notify_one();
+   }
 }
 
-void LocalMessageQueue::ProcessMessages() {
+void LocalMessageQueue::ProcessMessages(const bool& retire) {
+   std::vector<Message> drained;
+   HandlerRegistry::Run run;
    while (true) {
-      Message msg;
+      bool more = false;
+      bool hasDeadline = false; // only ever the first message of the batch
+      size_t shard = NoShard;
+      std::shared_ptr<const ExpiredHandler> onExpired;
       {
          std::unique_lock<std::mutex> lock(queueMutex);
-         condition.wait(lock, [this] {
-            return !running || !messageQueue.empty();
+         condition.wait(lock, [this, &retire] {
+            return !running || retire || queuedCount > 0 || !readyShards.empty();
             });
 
-         if (!running && messageQueue.empty()) {
+         // A retired worker leaves the queued messages to the others
+         if (retire) {
+            break;
+         }
+         // Shards held by other workers are finished by those workers
+         if (!running && queuedCount == 0 && readyShards.empty()) {
             break;
          }
 
-         if (!messageQueue.empty()) {
-            msg = std::move(messageQueue.front());
-            messageQueue.pop();
+         shard = TakeBatch(drained, hasDeadline);
+         more = queuedCount > 0 || !readyShards.empty();
+         if (hasDeadline) {
+            onExpired = expiredHandler;
          }
       }
+      if (more) {
+         condition.notify_one();
+      }
+      Clock::time_point began = Clock::now();
+      if (hasDeadline && CheckExpired(drained.front(), onExpired)) {
+         drained.erase(drained.begin());
+      }
 
-      std::lock_guard<std::mutex> lock(handlerMutex);
-      auto it = handlers.find(msg.id);
-      if (it != handlers.end()) {
-         for (const auto& handler : it->second) {
-            try {
-               handler(msg.params);
-            }
-            catch (const std::exception& e) {
-               // Handle exception (log error, etc.)
-            }
-         }
+      // No lock held here: workers run handlers concurrently on a registry snapshot
+      handlers.DispatchDrained(drained, run, [this](Message& msg) {
+         handlers.Respond(msg.id, msg.params, pending, msg.correlation);
+         });
+      drained.clear();
+
+      if (shard != NoShard) {
+         ReleaseShard(shard);
       }
+      busyNanos.fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - began).count()),
+         std::memory_order_relaxed);
    }
 }
\ No newline at end of file
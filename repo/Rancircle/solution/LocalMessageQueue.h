@@ -1,34 +1,219 @@
 #pragma once
 #include "messageQueue.h"
-#include <queue>
+#include "HandlerRegistry.h"
+#include "nodePool.hpp"
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
 #include <mutex>
+#include <thread>
 #include <condition_variable>
 
+// Autoscaling of LocalMessageQueue workers. Every interval the queue samples its backlog
+// (messages queued but not yet taken by a worker) and how busy its workers were; it grows
+// the pool by half when messages pile up or the workers are saturated, and retires one
+// worker after idleIntervals quiet intervals in a row.
+struct AutoscalePolicy {
+   size_t minThreads = 1;
+   size_t maxThreads = 0;                    // 0 disables autoscaling
+   std::chrono::milliseconds interval{ 100 };
+   size_t backlogPerWorker = 64;             // grow when more messages than this wait per worker
+   double busyHigh = 0.85;                   // ... or when workers were busy longer than this share
+   double busyLow = 0.25;                    // quiet: nothing waiting and workers less busy than this
+   size_t idleIntervals = 10;
+};
+
+// Scheduling lane of a message id; higher lanes are served first
+enum class MessagePriority {
+   High,    // control traffic (stop, reconfigure, ...)
+   Normal,
+   Low      // bulk traffic
+};
+
+// Messages wait in one FIFO lane per priority. Workers serve the highest non-empty lane,
+// except that a lower lane passed over StarvationLimit times in a row gets the next turn.
+// A message may carry a deadline; if it has passed by the time a worker is about to dispatch
+// it, the message goes to the expired handler (or is dropped) instead of its regular handlers.
+// A message with a deadline always starts a new batch, so the check is not stale.
+//
+// Keyed messages (QueueKeyedMessage) bypass the lanes: keys hash onto virtual shards, and
+// a shard is claimed by at most one worker at a time, so messages with the same key are
+// dispatched strictly in order while different shards run in parallel. A worker hands a
+// shard back after one batch, so a hot shard does not pin a worker and idle workers
+// pick up the other shards.
 class LocalMessageQueue : public IMessageQueue {
 public:
-   explicit LocalMessageQueue(size_t numThreads = 1);
+   using Clock = std::chrono::steady_clock;
+   using ExpiredHandler = std::function<void(MessageId, const ParameterPack&)>;
+
+   static constexpr size_t DefaultKeyShards = 64;
+
+   explicit LocalMessageQueue(size_t numThreads = 1, size_t keyShards = DefaultKeyShards);
    ~LocalMessageQueue();
 
    void Start() override;
    void Stop() override;
+   // Adds or retires workers while running; queued messages keep flowing. A retired worker
+   // finishes its current batch first. Must not be called from a handler.
    void SetThreadCount(size_t numThreads) override;
    void RegisterHandler(MessageId id, MessageHandler handler) override;
+   void RegisterRequestHandler(MessageId id, RequestHandler handler) override;
+   void RegisterBatchHandler(MessageId id, BatchHandler handler) override;
+   void SetBatchSize(size_t maxMessages) override;
+   void RegisterPayloadHandler(MessageId id, PayloadHandler handler) override;
+   void SetFanOut(MessageId id, bool parallel, JoinHandler onJoin,
+      std::shared_ptr<IExecutor> executor = nullptr) override;
+   void SetWorkerPlacement(const WorkerPlacement& workerPlacement) override;
+   // Expired messages count as dropped
+   void EnableMetrics(bool enabled) override;
+   MetricsSnapshot SnapshotMetrics() const override;
+
+   // Lane for id (Normal unless set); applies to messages queued afterwards
+   void SetPriority(MessageId id, MessagePriority priority);
+   // Receives expired messages on the worker; without one they are dropped
+   void SetExpiredHandler(ExpiredHandler handler);
+   // Messages that missed their deadline, whether dropped or handed to the expired handler
+   size_t ExpiredCount() const { return expired.load(std::memory_order_relaxed); }
+   // Replaces the autoscaling policy; takes effect at once if running
+   void SetAutoscale(const AutoscalePolicy& policy);
+   // Workers currently running (changes under autoscaling)
+   size_t ThreadCount();
+   // Message slots of the lanes and shards: queued messages reuse slots freed by earlier
+   // ones, so only growth past highWaterMark allocates
+   PoolStats MessagePoolStats();
+
+   template<typename... Args>
+   void QueueMessageBefore(Clock::time_point deadline, MessageId id, Args... args) {
+      Message msg{ id, MakeParameters(std::move(args)...) };
+      msg.deadline = deadline;
+      Push(std::move(msg));
+   }
+
+   // Messages with the same key (e.g. a stream or camera id) are handled in queue order,
+   // one at a time; lane priorities do not apply to them
+   template<typename... Args>
+   void QueueKeyedMessage(uint64_t key, MessageId id, Args... args) {
+      PushKeyed(key, { id, MakeParameters(std::move(args)...) });
+   }
 
 protected:
-   void QueueMessageImpl(MessageId id, const std::vector<Parameter>& params) override;
-   void ProcessMessages();
+   void QueueMessageImpl(MessageId id, ParameterPack&& params) override;
+   void QueueMessagesImpl(const BatchMessage* messages, size_t count) override;
+   ReplyFuture RequestImpl(MessageId id, ParameterPack&& params, std::chrono::milliseconds timeout) override;
+   void QueuePayloadImpl(MessageId id, MessagePayload&& payload) override;
+   void ProcessMessages(const bool& retire);
 
 private:
+   struct Worker {
+      std::unique_ptr<std::thread> thread;
+      bool retire = false; // guarded by queueMutex
+   };
+
+   // Built from { id, params[, correlation] }; the other fields keep their defaults
    struct Message {
-      MessageId id;
-      std::vector<Parameter> params;
+      Message() = default;
+      Message(MessageId messageId, ParameterPack parameters = ParameterPack(), uint64_t correlationId = 0)
+         : id(messageId), params(std::move(parameters)), correlation(correlationId) {}
+
+      MessageId id = 0;
+      ParameterPack params;
+      uint64_t correlation = 0; // non-zero for requests
+      Clock::time_point deadline = Clock::time_point::max();
+      MessagePayload payload; // typed messages only
+      Clock::time_point enqueuedAt; // set only while metrics are enabled
    };
-   std::queue<Message> messageQueue;
-   std::map<MessageId, std::vector<MessageHandler>> handlers;
-   std::vector<std::unique_ptr<std::thread>> workerThreads;
+
+   // FIFO on a circular buffer that keeps its capacity, so steady traffic does not allocate
+   // (std::deque allocates a node every couple of messages of this size)
+   class MessageFifo {
+   public:
+      bool empty() const { return count == 0; }
+      size_t capacity() const { return slots.size(); }
+      Message& front() { return slots[head]; }
+
+      void pop_front() {
+         head = (head + 1) & (slots.size() - 1);
+         --count;
+      }
+
+      void push_back(Message&& msg) {
+         if (count == slots.size()) {
+            Grow();
+         }
+         slots[(head + count) & (slots.size() - 1)] = std::move(msg);
+         ++count;
+      }
+
+   private:
+      void Grow() {
+         std::vector<Message> next(slots.empty() ? 16 : slots.size() * 2);
+         for (size_t i = 0; i < count; ++i) {
+            next[i] = std::move(slots[(head + i) & (slots.size() - 1)]);
+         }
+         slots.swap(next);
+         head = 0;
+      }
+
+      std::vector<Message> slots; // size is zero or a power of two
+      size_t head = 0;
+      size_t count = 0;
+   };
+
+   static constexpr size_t LaneCount = 3;
+   static constexpr size_t StarvationLimit = 8;
+
+   // Messages of the keys that hash to one shard; scheduled while it is in readyShards or
+   // being dispatched by a worker
+   struct Shard {
+      MessageFifo messages;
+      bool scheduled = false;
+   };
+
+   void Stamp(Message& msg);
+   void Push(Message&& msg);
+   void PushKeyed(uint64_t key, Message&& msg);
+   size_t TakeBatch(std::vector<Message>& drained, bool& hasDeadline);
+   void ReleaseShard(size_t shard);
+   size_t LaneFor(MessageId id) const;
+   size_t PickLane() const;
+   void TakeFrom(size_t lane, std::vector<Message>& drained);
+   bool CheckExpired(const Message& msg, const std::shared_ptr<const ExpiredHandler>& onExpired);
+   void ResizeWorkers(size_t count);
+   void Autoscale();
+   void StartAutoscaler();
+   void StopAutoscaler();
+
+   // All guarded by queueMutex
+   MessageFifo lanes[LaneCount];
+   size_t skipped[LaneCount] = {};
+   size_t queuedCount;
+   uint64_t pushedCount;
+   uint64_t takenCount;
+   std::vector<Shard> shards;
+   std::deque<size_t> readyShards;
+   bool shardTurn; // alternates between lanes and shards when both have work
+   std::map<MessageId, MessagePriority> priorities;
+   std::shared_ptr<const ExpiredHandler> expiredHandler;
+
+   std::atomic<size_t> expired;
+   MetricsRegistry metrics;
+   HandlerRegistry handlers;
+   PendingRequestTable pending;
+   std::vector<std::unique_ptr<Worker>> workers; // guarded by resizeMutex
    std::mutex queueMutex;
-   std::mutex handlerMutex;
    std::condition_variable condition;
    bool running;
    size_t threadCount;
+   size_t batchSize; // guarded by queueMutex
+
+   // Serializes Start/Stop/SetThreadCount with the autoscaler
+   std::mutex resizeMutex;
+   WorkerPlacement placement; // guarded by resizeMutex
+   std::atomic<uint64_t> busyNanos; // time workers spent dispatching
+   AutoscalePolicy autoscale;       // guarded by autoscaleMutex
+   std::unique_ptr<std::thread> autoscaleThread;
+   std::mutex autoscaleMutex;
+   std::condition_variable autoscaleCondition;
+   bool autoscaleStop;              // guarded by autoscaleMutex
 };
\ No newline at end of file
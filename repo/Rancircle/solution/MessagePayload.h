@@ -0,0 +1,260 @@
+#pragma once
+#include "SharedBuffer.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// Fixed-layout wire format of one typed message field (see TypedMessage.h).
+// The layout is fixed by the message definition, so unlike ParameterCodec no type tags
+// are written: trivially copyable fields are stored as their bytes, strings and buffers
+// as [u32 length][bytes]. Both ends of an IPC queue share a machine (host byte order).
+template<typename T>
+struct PayloadField {
+   static_assert(std::is_trivially_copyable_v<T>,
+      "Typed message fields must be trivially copyable, std::string or SharedBuffer");
+
+   static size_t Size(const T&) { return sizeof(T); }
+
+   static unsigned char* Write(unsigned char* out, const T& value) {
+      memcpy(out, &value, sizeof(T));
+      return out + sizeof(T);
+   }
+
+   static bool Read(const unsigned char*& in, const unsigned char* end, T& value) {
+      if (static_cast<size_t>(end - in) < sizeof(T)) {
+         return false;
+      }
+      memcpy(&value, in, sizeof(T));
+      in += sizeof(T);
+      return true;
+   }
+};
+
+// Strings and buffers: [u32 length][bytes]
+struct PayloadBytesField {
+   static bool ReadLength(const unsigned char*& in, const unsigned char* end, uint32_t& length) {
+      if (!PayloadField<uint32_t>::Read(in, end, length)) {
+         return false;
+      }
+      return static_cast<size_t>(end - in) >= length;
+   }
+};
+
+template<>
+struct PayloadField<std::string> : PayloadBytesField {
+   static size_t Size(const std::string& value) { return sizeof(uint32_t) + value.size(); }
+
+   static unsigned char* Write(unsigned char* out, const std::string& value) {
+      out = PayloadField<uint32_t>::Write(out, static_cast<uint32_t>(value.size()));
+      memcpy(out, value.data(), value.size());
+      return out + value.size();
+   }
+
+   static bool Read(const unsigned char*& in, const unsigned char* end, std::string& value) {
+      uint32_t length;
+      if (!ReadLength(in, end, length)) {
+         return false;
+      }
+      value.assign(reinterpret_cast<const char*>(in), length);
+      in += length;
+      return true;
+   }
+};
+
+template<>
+struct PayloadField<SharedBuffer> : PayloadBytesField {
+   static size_t Size(const SharedBuffer& value) { return sizeof(uint32_t) + value.Size(); }
+
+   static unsigned char* Write(unsigned char* out, const SharedBuffer& value) {
+      out = PayloadField<uint32_t>::Write(out, static_cast<uint32_t>(value.Size()));
+      if (value.Size() > 0) {
+         memcpy(out, value.Data(), value.Size());
+      }
+      return out + value.Size();
+   }
+
+   static bool Read(const unsigned char*& in, const unsigned char* end, SharedBuffer& value) {
+      uint32_t length;
+      if (!ReadLength(in, end, length)) {
+         return false;
+      }
+      value = SharedBuffer(in, length);
+      in += length;
+      return true;
+   }
+};
+
+// Layout of a whole typed message: its fields back to back, in declaration order
+template<typename Tuple>
+struct PayloadLayout;
+
+template<typename... Fields>
+struct PayloadLayout<std::tuple<Fields...>> {
+   using Tuple = std::tuple<Fields...>;
+
+   static size_t Size(const Tuple& value) {
+      return std::apply([](const Fields&... fields) {
+         return (size_t{ 0 } + ... + PayloadField<Fields>::Size(fields));
+         }, value);
+   }
+
+   static void Write(unsigned char* out, const Tuple& value) {
+      std::apply([&out](const Fields&... fields) {
+         ((out = PayloadField<Fields>::Write(out, fields)), ...);
+         }, value);
+   }
+
+   // Fails on a truncated body or trailing bytes
+   static bool Read(const unsigned char* in, size_t size, Tuple& value) {
+      const unsigned char* end = in + size;
+      bool ok = std::apply([&in, end](Fields&... fields) {
+         return (true && ... && PayloadField<Fields>::Read(in, end, fields));
+         }, value);
+      return ok && in == end;
+   }
+};
+
+// Type-erased, movable holder for the argument tuple of a typed message.
+// Tuples of up to InlineSize bytes live inside the holder, so a typed message queued on an
+// in-process queue is not boxed into variants and (for small fields) does not allocate.
+// The held type is identified by its operations table, which needs no RTTI.
+class MessagePayload {
+public:
+   static constexpr size_t InlineSize = 64;
+
+   struct Ops {
+      void (*destroy)(void* object, bool isInline);
+      void (*relocate)(void* dst, void* src); // move-constructs into dst, destroys src
+      size_t (*encodedSize)(const void* object);
+      void (*encode)(const void* object, unsigned char* dst);
+   };
+
+   MessagePayload() = default;
+   MessagePayload(MessagePayload&& other) noexcept { MoveFrom(other); }
+
+   MessagePayload& operator=(MessagePayload&& other) noexcept {
+      if (this != &other) {
+         Reset();
+         MoveFrom(other);
+      }
+      return *this;
+   }
+
+   MessagePayload(const MessagePayload&) = delete;
+   MessagePayload& operator=(const MessagePayload&) = delete;
+
+   ~MessagePayload() { Reset(); }
+
+   template<typename T, typename... CtorArgs>
+   static MessagePayload Make(CtorArgs&&... args);
+
+   // Decodes a body written by Encode() for a payload holding T
+   template<typename T>
+   static bool Decode(const unsigned char* src, size_t size, MessagePayload& payload);
+
+   // The held T, or nullptr if the payload is empty or holds another type
+   template<typename T>
+   const T* Get() const;
+
+   bool Empty() const { return ops == nullptr; }
+   explicit operator bool() const { return ops != nullptr; }
+
+   size_t EncodedSize() const { return ops->encodedSize(object); }
+   void Encode(unsigned char* dst) const { ops->encode(object, dst); }
+
+   void Reset() {
+      if (ops) {
+         ops->destroy(object, IsInline());
+         ops = nullptr;
+         object = nullptr;
+      }
+   }
+
+private:
+   template<typename T>
+   static constexpr bool FitsInline = sizeof(T) <= InlineSize
+      && alignof(T) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<T>;
+
+   bool IsInline() const { return object == storage; }
+
+   void MoveFrom(MessagePayload& other) noexcept {
+      if (!other.ops) {
+         return;
+      }
+      if (other.IsInline()) {
+         other.ops->relocate(storage, other.storage);
+         object = storage;
+      }
+      else {
+         object = other.object;
+      }
+      ops = other.ops;
+      other.ops = nullptr;
+      other.object = nullptr;
+   }
+
+   const Ops* ops = nullptr;
+   void* object = nullptr;
+   alignas(std::max_align_t) unsigned char storage[InlineSize];
+};
+
+template<typename T>
+struct MessagePayloadOps {
+   static void Destroy(void* object, bool isInline) {
+      if (isInline) {
+         static_cast<T*>(object)->~T();
+      }
+      else {
+         delete static_cast<T*>(object);
+      }
+   }
+
+   static void Relocate(void* dst, void* src) {
+      new (dst) T(std::move(*static_cast<T*>(src)));
+      static_cast<T*>(src)->~T();
+   }
+
+   static size_t EncodedSize(const void* object) {
+      return PayloadLayout<T>::Size(*static_cast<const T*>(object));
+   }
+
+   static void Encode(const void* object, unsigned char* dst) {
+      PayloadLayout<T>::Write(dst, *static_cast<const T*>(object));
+   }
+
+   // One table per type; its address identifies T
+   static inline const MessagePayload::Ops table = { &Destroy, &Relocate, &EncodedSize, &Encode };
+};
+
+template<typename T, typename... CtorArgs>
+MessagePayload MessagePayload::Make(CtorArgs&&... args) {
+   MessagePayload payload;
+   if constexpr (FitsInline<T>) {
+      payload.object = new (payload.storage) T(std::forward<CtorArgs>(args)...);
+   }
+   else {
+      payload.object = new T(std::forward<CtorArgs>(args)...);
+   }
+   payload.ops = &MessagePayloadOps<T>::table;
+   return payload;
+}
+
+template<typename T>
+bool MessagePayload::Decode(const unsigned char* src, size_t size, MessagePayload& payload) {
+   T value{};
+   if (!PayloadLayout<T>::Read(src, size, value)) {
+      return false;
+   }
+   payload = Make<T>(std::move(value));
+   return true;
+}
+
+template<typename T>
+const T* MessagePayload::Get() const {
+   return ops == &MessagePayloadOps<T>::table ? static_cast<const T*>(object) : nullptr;
+}
\ No newline at end of file
@@ -2,9 +2,18 @@
 
 #include "messageQueue.h"
 #include "LocalMessageQueue.h"
+#include "RingMessageQueue.h"
 #include "IPCMessageQueue.h"
+#include "NumaMessageQueue.h"
 #include <memory>
 
+enum class MessageQueueType {
+   Local,         // mutex + condition_variable FIFO
+   LockFreeRing,  // bounded lock-free MPMC ring
+   IPC,           // cross-process queue
+   Numa           // one Local queue per NUMA node, numThreads workers on each
+};
+
 class MessageQueueFactory {
 public:
    static std::unique_ptr<IMessageQueue> CreateMessageQueue(
@@ -12,9 +21,27 @@ public:
       const std::string& ipcName = "",
       size_t numThreads = 1
    ) {
-      if (useIPC) {
+      return CreateMessageQueue(useIPC ? MessageQueueType::IPC : MessageQueueType::Local, ipcName, numThreads);
+   }
+
+   // ringCapacity and policy only apply to MessageQueueType::LockFreeRing
+   static std::unique_ptr<IMessageQueue> CreateMessageQueue(
+      MessageQueueType type,
+      const std::string& ipcName = "",
+      size_t numThreads = 1,
+      size_t ringCapacity = 1024,
+      BackpressurePolicy policy = BackpressurePolicy::Block
+   ) {
+      switch (type) {
+      case MessageQueueType::IPC:
          return std::make_unique<IPCMessageQueue>(ipcName, numThreads);
+      case MessageQueueType::LockFreeRing:
+         return std::make_unique<RingMessageQueue>(numThreads, ringCapacity, policy);
+      case MessageQueueType::Numa:
+         return std::make_unique<NumaMessageQueue>(numThreads);
+      case MessageQueueType::Local:
+      default:
+         return std::make_unique<LocalMessageQueue>(numThreads);
       }
-      return std::make_unique<LocalMessageQueue>(numThreads);
    }
 };
\ No newline at end of file
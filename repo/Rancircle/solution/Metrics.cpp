@@ -0,0 +1,304 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+   std::atomic<uint64_t> nextSerial{ 1 };
+
+   int FloorLog2(uint64_t value) {
+      int exponent = 0;
+      while (value >>= 1) {
+         ++exponent;
+      }
+      return exponent;
+   }
+
+   std::string Seconds(uint64_t nanos) {
+      char text[32];
+      snprintf(text, sizeof(text), "%.9g", nanos / 1e9);
+      return text;
+   }
+}
+
+size_t HistogramSnapshot::BucketOf(uint64_t nanos) {
+   if (nanos < SubBuckets) {
+      return static_cast<size_t>(nanos);
+   }
+   size_t exponent = static_cast<size_t>(FloorLog2(nanos));
+   if (exponent > MaxExponent) {
+      return BucketCount - 1;
+   }
+   size_t sub = static_cast<size_t>(nanos >> (exponent - 4)) & (SubBuckets - 1);
+   return (exponent - 3) * SubBuckets + sub;
+}
+
+uint64_t HistogramSnapshot::ValueOf(size_t bucket) {
+   if (bucket < SubBuckets) {
+      return bucket;
+   }
+   size_t exponent = bucket / SubBuckets + 3;
+   uint64_t width = 1ull << (exponent - 4);
+   return (SubBuckets + bucket % SubBuckets) * width + width / 2;
+}
+
+uint64_t HistogramSnapshot::Percentile(double p) const {
+   if (count == 0) {
+      return 0;
+   }
+   uint64_t rank = static_cast<uint64_t>(std::ceil(std::min(std::max(p, 0.0), 1.0) * count));
+   rank = std::max<uint64_t>(rank, 1);
+   uint64_t seen = 0;
+   for (size_t i = 0; i < buckets.size(); ++i) {
+      seen += buckets[i];
+      if (seen >= rank) {
+         return ValueOf(i);
+      }
+   }
+   return MaxNanos();
+}
+
+uint64_t HistogramSnapshot::MaxNanos() const {
+   for (size_t i = buckets.size(); i > 0; --i) {
+      if (buckets[i - 1] != 0) {
+         return ValueOf(i - 1);
+      }
+   }
+   return 0;
+}
+
+void HistogramSnapshot::Merge(const HistogramSnapshot& other) {
+   count += other.count;
+   sumNanos += other.sumNanos;
+   for (size_t i = 0; i < buckets.size(); ++i) {
+      buckets[i] += other.buckets[i];
+   }
+}
+
+const MessageMetrics* MetricsSnapshot::Find(int64_t id) const {
+   for (const MessageMetrics& entry : messages) {
+      if (entry.id == id) {
+         return &entry;
+      }
+   }
+   return nullptr;
+}
+
+void MetricsSnapshot::Merge(const MetricsSnapshot& other) {
+   for (const MessageMetrics& entry : other.messages) {
+      auto it = std::lower_bound(messages.begin(), messages.end(), entry.id,
+         [](const MessageMetrics& existing, int64_t id) { return existing.id < id; });
+      if (it == messages.end() || it->id != entry.id) {
+         messages.insert(it, entry);
+         continue;
+      }
+      it->enqueued += entry.enqueued;
+      it->dispatched += entry.dispatched;
+      it->dropped += entry.dropped;
+      it->exceptions += entry.exceptions;
+      it->wait.Merge(entry.wait);
+      it->handler.Merge(entry.handler);
+   }
+}
+
+std::string MetricsSnapshot::ToText(const std::string& prefix) const {
+   std::string text;
+   auto label = [](const MessageMetrics& entry) {
+      return entry.id == OtherId ? std::string("id=\"other\"") : "id=\"" + std::to_string(entry.id) + "\"";
+   };
+   auto counter = [&](const char* name, const char* help, uint64_t MessageMetrics::* field) {
+      text += "# HELP " + prefix + "_" + name + "_total " + help + "\n";
+      text += "# TYPE " + prefix + "_" + name + "_total counter\n";
+      for (const MessageMetrics& entry : messages) {
+         text += prefix + "_" + name + "_total{" + label(entry) + "} " + std::to_string(entry.*field) + "\n";
+      }
+   };
+   auto summary = [&](const char* name, const char* help, HistogramSnapshot MessageMetrics::* field) {
+      text += "# HELP " + prefix + "_" + name + "_seconds " + help + "\n";
+      text += "# TYPE " + prefix + "_" + name + "_seconds summary\n";
+      for (const MessageMetrics& entry : messages) {
+         const HistogramSnapshot& histogram = entry.*field;
+         if (histogram.count == 0) {
+            continue;
+         }
+         for (const char* quantile : { "0.5", "0.9", "0.99", "0.999", "1" }) {
+            text += prefix + "_" + name + "_seconds{" + label(entry) + ",quantile=\"" + quantile + "\"} "
+               + Seconds(histogram.Percentile(std::stod(quantile))) + "\n";
+         }
+         text += prefix + "_" + name + "_seconds_sum{" + label(entry) + "} " + Seconds(histogram.sumNanos) + "\n";
+         text += prefix + "_" + name + "_seconds_count{" + label(entry) + "} " + std::to_string(histogram.count) + "\n";
+      }
+   };
+
+   counter("enqueued", "Messages queued.", &MessageMetrics::enqueued);
+   counter("dispatched", "Messages taken by a worker for dispatch.", &MessageMetrics::dispatched);
+   counter("dropped", "Messages that never reached a handler.", &MessageMetrics::dropped);
+   counter("handler_exceptions", "Exceptions thrown by handlers.", &MessageMetrics::exceptions);
+
+   text += "# HELP " + prefix + "_depth Messages queued and not yet dispatched.\n";
+   text += "# TYPE " + prefix + "_depth gauge\n";
+   for (const MessageMetrics& entry : messages) {
+      text += prefix + "_depth{" + label(entry) + "} " + std::to_string(entry.Depth()) + "\n";
+   }
+
+   summary("wait", "Time from enqueue to dispatch.", &MessageMetrics::wait);
+   summary("handler", "Handler execution time.", &MessageMetrics::handler);
+   return text;
+}
+
+// Written only by the thread owning its shard; the atomics let a snapshot read it meanwhile
+class MetricsRegistry::Histogram {
+public:
+   void Record(uint64_t nanos) {
+      buckets[HistogramSnapshot::BucketOf(nanos)].fetch_add(1, std::memory_order_relaxed);
+      count.fetch_add(1, std::memory_order_relaxed);
+      sum.fetch_add(nanos, std::memory_order_relaxed);
+   }
+
+   void AddTo(HistogramSnapshot& snapshot) const {
+      snapshot.count += count.load(std::memory_order_relaxed);
+      snapshot.sumNanos += sum.load(std::memory_order_relaxed);
+      for (size_t i = 0; i < HistogramSnapshot::BucketCount; ++i) {
+         snapshot.buckets[i] += buckets[i].load(std::memory_order_relaxed);
+      }
+   }
+
+private:
+   std::atomic<uint64_t> count{ 0 };
+   std::atomic<uint64_t> sum{ 0 };
+   std::atomic<uint64_t> buckets[HistogramSnapshot::BucketCount] = {};
+};
+
+// Aligned so that the slots of different threads' shards never share a cache line
+struct alignas(64) MetricsRegistry::IdMetrics {
+   std::atomic<uint64_t> enqueued{ 0 };
+   std::atomic<uint64_t> dispatched{ 0 };
+   std::atomic<uint64_t> dropped{ 0 };
+   std::atomic<uint64_t> exceptions{ 0 };
+   Histogram wait;
+   Histogram handler;
+};
+
+// One thread's metrics. Slots are created by that thread only and published for Snapshot()
+struct MetricsRegistry::Shard {
+   Shard() : direct(new std::atomic<IdMetrics*>[DirectIds]), other(nullptr) {
+      for (size_t i = 0; i < DirectIds; ++i) {
+         direct[i].store(nullptr, std::memory_order_relaxed);
+      }
+   }
+
+   ~Shard() {
+      for (size_t i = 0; i < DirectIds; ++i) {
+         delete direct[i].load();
+      }
+      delete other.load();
+   }
+
+   IdMetrics& For(int64_t id) {
+      std::atomic<IdMetrics*>& slot = id >= 0 && static_cast<uint64_t>(id) < DirectIds ? direct[id] : other;
+      IdMetrics* metrics = slot.load(std::memory_order_relaxed);
+      if (!metrics) {
+         metrics = new IdMetrics();
+         slot.store(metrics, std::memory_order_release);
+      }
+      return *metrics;
+   }
+
+   std::unique_ptr<std::atomic<IdMetrics*>[]> direct;
+   std::atomic<IdMetrics*> other;
+};
+
+MetricsRegistry::MetricsRegistry()
+   : on(false), serial(nextSerial.fetch_add(1, std::memory_order_relaxed)) {}
+
+MetricsRegistry::~MetricsRegistry() = default;
+
+// The calling thread's shard. Each thread caches the shards of the last few registries it
+// recorded into; a miss takes shardMutex once to find or create the shard.
+MetricsRegistry::Shard& MetricsRegistry::Local() {
+   struct Cached {
+      uint64_t serial = 0;
+      Shard* shard = nullptr;
+   };
+   static constexpr size_t CacheSize = 4;
+   thread_local Cached cache[CacheSize];
+   thread_local size_t victim = 0;
+
+   for (const Cached& entry : cache) {
+      if (entry.serial == serial) {
+         return *entry.shard;
+      }
+   }
+
+   Shard* shard;
+   {
+      std::lock_guard<std::mutex> lock(shardMutex);
+      std::unique_ptr<Shard>& owned = shards[std::this_thread::get_id()];
+      if (!owned) {
+         owned = std::make_unique<Shard>();
+      }
+      shard = owned.get();
+   }
+   cache[victim] = Cached{ serial, shard };
+   victim = (victim + 1) % CacheSize;
+   return *shard;
+}
+
+void MetricsRegistry::Enqueued(int64_t id, size_t count) {
+   Local().For(id).enqueued.fetch_add(count, std::memory_order_relaxed);
+}
+
+void MetricsRegistry::Dispatched(int64_t id, Clock::time_point enqueuedAt, Clock::time_point now) {
+   IdMetrics& metrics = Local().For(id);
+   metrics.dispatched.fetch_add(1, std::memory_order_relaxed);
+   if (enqueuedAt != Clock::time_point() && now >= enqueuedAt) {
+      metrics.wait.Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - enqueuedAt).count()));
+   }
+}
+
+void MetricsRegistry::HandlerRan(int64_t id, Clock::duration elapsed) {
+   auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+   Local().For(id).handler.Record(nanos > 0 ? static_cast<uint64_t>(nanos) : 0);
+}
+
+void MetricsRegistry::HandlerFailed(int64_t id) {
+   Local().For(id).exceptions.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MetricsRegistry::Dropped(int64_t id, size_t count) {
+   Local().For(id).dropped.fetch_add(count, std::memory_order_relaxed);
+}
+
+MetricsSnapshot MetricsRegistry::Snapshot() const {
+   MetricsSnapshot snapshot;
+   std::lock_guard<std::mutex> lock(shardMutex);
+   // index DirectIds stands for the shared OtherId slot
+   auto add = [this, &snapshot](int64_t id, size_t index) {
+      MessageMetrics entry;
+      entry.id = id;
+      bool seen = false;
+      for (const auto& owned : shards) {
+         const Shard& shard = *owned.second;
+         const std::atomic<IdMetrics*>& slot = index < DirectIds ? shard.direct[index] : shard.other;
+         const IdMetrics* metrics = slot.load(std::memory_order_acquire);
+         if (!metrics) {
+            continue;
+         }
+         seen = true;
+         entry.enqueued += metrics->enqueued.load(std::memory_order_relaxed);
+         entry.dispatched += metrics->dispatched.load(std::memory_order_relaxed);
+         entry.dropped += metrics->dropped.load(std::memory_order_relaxed);
+         entry.exceptions += metrics->exceptions.load(std::memory_order_relaxed);
+         metrics->wait.AddTo(entry.wait);
+         metrics->handler.AddTo(entry.handler);
+      }
+      if (seen) {
+         snapshot.messages.push_back(std::move(entry));
+      }
+   };
+   add(MetricsSnapshot::OtherId, DirectIds);
+   for (size_t i = 0; i < DirectIds; ++i) {
+      add(static_cast<int64_t>(i), i);
+   }
+   return snapshot;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Latency distribution in nanoseconds with HDR-style log-linear buckets: values below 16 are
+// exact, larger ones fall into 16 buckets per power of two (relative error under 6.25%),
+// up to about 18 minutes.
+struct HistogramSnapshot {
+   static constexpr size_t SubBuckets = 16;
+   static constexpr size_t MaxExponent = 40;
+   static constexpr size_t BucketCount = (MaxExponent - 3 + 1) * SubBuckets;
+
+   uint64_t count = 0;
+   uint64_t sumNanos = 0;
+   std::vector<uint64_t> buckets = std::vector<uint64_t>(BucketCount);
+
+   static size_t BucketOf(uint64_t nanos);
+   // Middle of the bucket's range
+   static uint64_t ValueOf(size_t bucket);
+
+   // Value below which a share p (0..1) of the samples lie; 0 without samples
+   uint64_t Percentile(double p) const;
+   uint64_t MaxNanos() const;
+   double MeanNanos() const { return count ? static_cast<double>(sumNanos) / count : 0.0; }
+   void Merge(const HistogramSnapshot& other);
+};
+
+// Counters and latencies of one message id (or event key)
+struct MessageMetrics {
+   int64_t id = 0;          // OtherId for ids beyond MetricsRegistry::DirectIds
+   uint64_t enqueued = 0;
+   uint64_t dispatched = 0;
+   uint64_t dropped = 0;    // never reached a handler (backpressure, expired, failed to send)
+   uint64_t exceptions = 0; // thrown by handlers
+   HistogramSnapshot wait;  // enqueue to dispatch
+   HistogramSnapshot handler;
+
+   // Messages queued but not yet dispatched
+   uint64_t Depth() const {
+      uint64_t done = dispatched + dropped;
+      return enqueued > done ? enqueued - done : 0;
+   }
+};
+
+struct MetricsSnapshot {
+   static constexpr int64_t OtherId = -1;
+
+   std::vector<MessageMetrics> messages; // ordered by id, ids with no activity left out
+
+   const MessageMetrics* Find(int64_t id) const;
+   void Merge(const MetricsSnapshot& other);
+   // Plain-text exposition (Prometheus format): counters as <prefix>_<name>_total, depth as a
+   // gauge and the latencies as summaries in seconds. Rates are left to the scraper.
+   std::string ToText(const std::string& prefix) const;
+};
+
+// Instrumentation shared by the message queues and EventCallbackDispatcher.
+// Off by default; while off, every hook is one relaxed load and callers skip taking
+// timestamps. Every thread that records gets its own shard of counters and histograms,
+// registered with the registry on first use and summed when a snapshot is taken, so workers
+// never write the same cache line. A shard outlives its thread and is handed to the next
+// thread that gets the same thread id. Ids below DirectIds are tracked individually (slots
+// are created on first use); larger ids share one OtherId entry.
+class MetricsRegistry {
+public:
+   using Clock = std::chrono::steady_clock;
+
+   static constexpr size_t DirectIds = 1024;
+
+   MetricsRegistry();
+   ~MetricsRegistry();
+
+   MetricsRegistry(const MetricsRegistry&) = delete;
+   MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+   void Enable(bool enabled) { on.store(enabled, std::memory_order_relaxed); }
+   bool Enabled() const { return on.load(std::memory_order_relaxed); }
+
+   // The hooks record whether or not the registry is enabled; callers check Enabled() first
+   void Enqueued(int64_t id, size_t count = 1);
+   // enqueuedAt is Clock::time_point() when unknown (no wait sample then)
+   void Dispatched(int64_t id, Clock::time_point enqueuedAt, Clock::time_point now);
+   void HandlerRan(int64_t id, Clock::duration elapsed);
+   void HandlerFailed(int64_t id);
+   void Dropped(int64_t id, size_t count = 1);
+
+   MetricsSnapshot Snapshot() const;
+
+private:
+   class Histogram;
+   struct IdMetrics;
+   struct Shard;
+
+   Shard& Local();
+
+   std::atomic<bool> on;
+   const uint64_t serial; // tells the registry apart in the threads' shard caches
+   mutable std::mutex shardMutex;
+   std::unordered_map<std::thread::id, std::unique_ptr<Shard>> shards; // guarded by shardMutex
+};
\ No newline at end of file
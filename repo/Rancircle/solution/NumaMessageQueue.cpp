@@ -0,0 +1,117 @@
+#include "NumaMessageQueue.h"
+
+NumaMessageQueue::NumaMessageQueue(size_t threadsPerNode) {
+   size_t nodeCount = CpuTopology::Current().NodeCount();
+   for (size_t node = 0; node < nodeCount; ++node) {
+      auto queue = std::make_unique<LocalMessageQueue>(threadsPerNode);
+      if (nodeCount > 1) {
+         queue->SetWorkerPlacement(WorkerPlacement::OnNode(node));
+      }
+      nodes.push_back(std::move(queue));
+   }
+}
+
+NumaMessageQueue::~NumaMessageQueue() {
+   Stop();
+}
+
+void NumaMessageQueue::Start() {
+   for (auto& queue : nodes) {
+      queue->Start();
+   }
+}
+
+void NumaMessageQueue::Stop() {
+   for (auto& queue : nodes) {
+      queue->Stop();
+   }
+}
+
+void NumaMessageQueue::SetThreadCount(size_t numThreads) {
+   for (auto& queue : nodes) {
+      queue->SetThreadCount(numThreads);
+   }
+}
+
+void NumaMessageQueue::RegisterHandler(MessageId id, MessageHandler handler) {
+   for (auto& queue : nodes) {
+      queue->RegisterHandler(id, handler);
+   }
+}
+
+void NumaMessageQueue::RegisterRequestHandler(MessageId id, RequestHandler handler) {
+   for (auto& queue : nodes) {
+      queue->RegisterRequestHandler(id, handler);
+   }
+}
+
+void NumaMessageQueue::RegisterBatchHandler(MessageId id, BatchHandler handler) {
+   for (auto& queue : nodes) {
+      queue->RegisterBatchHandler(id, handler);
+   }
+}
+
+void NumaMessageQueue::SetBatchSize(size_t maxMessages) {
+   for (auto& queue : nodes) {
+      queue->SetBatchSize(maxMessages);
+   }
+}
+
+void NumaMessageQueue::RegisterPayloadHandler(MessageId id, PayloadHandler handler) {
+   for (auto& queue : nodes) {
+      queue->RegisterPayloadHandler(id, handler);
+   }
+}
+
+void NumaMessageQueue::SetFanOut(MessageId id, bool parallel, JoinHandler onJoin, std::shared_ptr<IExecutor> executor) {
+   for (auto& queue : nodes) {
+      queue->SetFanOut(id, parallel, onJoin, executor);
+   }
+}
+
+void NumaMessageQueue::SetWorkerPlacement(const WorkerPlacement& placement) {
+   for (size_t node = 0; node < nodes.size(); ++node) {
+      if (placement.Empty() && nodes.size() > 1) {
+         nodes[node]->SetWorkerPlacement(WorkerPlacement::OnNode(node));
+      }
+      else {
+         nodes[node]->SetWorkerPlacement(placement);
+      }
+   }
+}
+
+void NumaMessageQueue::EnableMetrics(bool enabled) {
+   for (auto& queue : nodes) {
+      queue->EnableMetrics(enabled);
+   }
+}
+
+MetricsSnapshot NumaMessageQueue::SnapshotMetrics() const {
+   MetricsSnapshot snapshot;
+   for (const auto& queue : nodes) {
+      snapshot.Merge(queue->SnapshotMetrics());
+   }
+   return snapshot;
+}
+
+LocalMessageQueue& NumaMessageQueue::Nearest() {
+   size_t node = CpuTopology::Current().CurrentNode();
+   return *nodes[node < nodes.size() ? node : 0];
+}
+
+void NumaMessageQueue::QueueMessageImpl(MessageId id, ParameterPack&& params) {
+   Forward(Nearest(), id, std::move(params));
+}
+
+void NumaMessageQueue::QueueMessagesImpl(const BatchMessage* messages, size_t count) {
+   Forward(Nearest(), messages, count);
+}
+
+NumaMessageQueue::ReplyFuture NumaMessageQueue::RequestImpl(MessageId id, ParameterPack&& params,
+   std::chrono::milliseconds timeout) {
+   return ForwardRequest(Nearest(), id, std::move(params), timeout);
+}
+
+void NumaMessageQueue::QueuePayloadImpl(MessageId id, MessagePayload&& payload) {
+   Forward(Nearest(), id, std::move(payload));
+}
\ No newline at end of file
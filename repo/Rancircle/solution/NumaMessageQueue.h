@@ -0,0 +1,57 @@
+#pragma once
+#include "messageQueue.h"
+#include "LocalMessageQueue.h"
+#include <memory>
+#include <vector>
+
+// One LocalMessageQueue per NUMA node, each with its workers restricted to that node's CPUs.
+// A message is queued on the node the producer is running on, so the queue slots it lands in
+// (first touched by producers on that node), its parameters and the worker that handles it
+// stay on one node instead of bouncing across the interconnect.
+// Messages from a producer that migrates between nodes may be handled out of order; keyed
+// messages are routed by key, not by producer, so per-key order still holds.
+class NumaMessageQueue : public IMessageQueue {
+public:
+   // threadsPerNode workers on each node
+   explicit NumaMessageQueue(size_t threadsPerNode = 1);
+   ~NumaMessageQueue();
+
+   void Start() override;
+   void Stop() override;
+   // Workers per node
+   void SetThreadCount(size_t numThreads) override;
+   void RegisterHandler(MessageId id, MessageHandler handler) override;
+   void RegisterRequestHandler(MessageId id, RequestHandler handler) override;
+   void RegisterBatchHandler(MessageId id, BatchHandler handler) override;
+   void SetBatchSize(size_t maxMessages) override;
+   void RegisterPayloadHandler(MessageId id, PayloadHandler handler) override;
+   void SetFanOut(MessageId id, bool parallel, JoinHandler onJoin,
+      std::shared_ptr<IExecutor> executor = nullptr) override;
+   // Applies placement to the workers of every node; an empty placement restores the
+   // default of keeping each node's workers on that node
+   void SetWorkerPlacement(const WorkerPlacement& placement) override;
+   // Applies to every node; the snapshot sums the nodes
+   void EnableMetrics(bool enabled) override;
+   MetricsSnapshot SnapshotMetrics() const override;
+
+   size_t NodeCount() const { return nodes.size(); }
+   // The queue of one node, for settings such as priorities or autoscaling
+   LocalMessageQueue& NodeQueue(size_t node) { return *nodes[node]; }
+
+   template<typename... Args>
+   void QueueKeyedMessage(uint64_t key, MessageId id, Args... args) {
+      nodes[key % nodes.size()]->QueueKeyedMessage(key, id, std::move(args)...);
+   }
+
+protected:
+   void QueueMessageImpl(MessageId id, ParameterPack&& params) override;
+   void QueueMessagesImpl(const BatchMessage* messages, size_t count) override;
+   ReplyFuture RequestImpl(MessageId id, ParameterPack&& params, std::chrono::milliseconds timeout) override;
+   void QueuePayloadImpl(MessageId id, MessagePayload&& payload) override;
+
+private:
+   // The queue of the node the calling thread is running on
+   LocalMessageQueue& Nearest();
+
+   std::vector<std::unique_ptr<LocalMessageQueue>> nodes;
+};
\ No newline at end of file
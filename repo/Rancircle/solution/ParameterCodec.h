@@ -0,0 +1,234 @@
+#pragma once
+#include "messageQueue.h"
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Binary wire format for IMessageQueue::Parameter lists sent across processes.
+//
+//   [u8 version][u16 count] then per parameter: [u8 type tag][value]
+//      Int    (1): 4 bytes          Float  (2): 4 bytes (IEEE-754, bit exact)
+//      Double (3): 8 bytes          String (4): [u32 length][length bytes]
+//      Buffer (5): [u32 length][length bytes]
+//      BufferRef (6): [u64 pool handle][u64 length] - a SharedBuffer living in the
+//                     ISharedBufferPool passed to Encode/Decode; one reference travels with it
+//
+// Multi-byte fields use the host byte order: both ends of an IPC queue share a machine.
+// Tags are fixed numbers rather than typeid hashes, so they are stable across builds.
+class ParameterCodec {
+public:
+   using Parameter = IMessageQueue::Parameter;
+   using ParameterPack = IMessageQueue::ParameterPack;
+
+   static constexpr uint8_t Version = 1;
+
+   enum TypeTag : uint8_t {
+      TagInt = 1,
+      TagFloat = 2,
+      TagDouble = 3,
+      TagString = 4,
+      TagBuffer = 5,
+      TagBufferRef = 6
+   };
+
+   static_assert(std::variant_size_v<Parameter> == 5
+      && std::is_same_v<std::variant_alternative_t<0, Parameter>, int>
+      && std::is_same_v<std::variant_alternative_t<1, Parameter>, float>
+      && std::is_same_v<std::variant_alternative_t<2, Parameter>, double>
+      && std::is_same_v<std::variant_alternative_t<3, Parameter>, std::string>
+      && std::is_same_v<std::variant_alternative_t<4, Parameter>, SharedBuffer>,
+      "ParameterCodec tags must be updated together with IMessageQueue::Parameter");
+
+   static size_t EncodedSize(const ParameterPack& params, const ISharedBufferPool* pool = nullptr) {
+      size_t size = HeaderSize;
+      for (const auto& param : params) {
+         size += 1;
+         switch (param.index()) {
+         case 0: size += sizeof(int32_t); break;
+         case 1: size += sizeof(float); break;
+         case 2: size += sizeof(double); break;
+         case 3: size += sizeof(uint32_t) + std::get<std::string>(param).size(); break;
+         default: {
+            const SharedBuffer& buffer = std::get<SharedBuffer>(param);
+            size += IsPooled(buffer, pool) ? 2 * sizeof(uint64_t) : sizeof(uint32_t) + buffer.Size();
+            break;
+         }
+         }
+      }
+      return size;
+   }
+
+   // Throws std::length_error if params cannot be encoded: more than UINT16_MAX parameters,
+   // or a string or inline buffer longer than UINT32_MAX bytes
+   static void Validate(const ParameterPack& params, const ISharedBufferPool* pool = nullptr) {
+      if (params.size() > UINT16_MAX) {
+         throw std::length_error("ParameterCodec: too many parameters");
+      }
+      for (const auto& param : params) {
+         if (const std::string* value = std::get_if<std::string>(&param)) {
+            if (value->size() > UINT32_MAX) {
+               throw std::length_error("ParameterCodec: string too large");
+            }
+         }
+         else if (const SharedBuffer* buffer = std::get_if<SharedBuffer>(&param)) {
+            if (!IsPooled(*buffer, pool) && buffer->Size() > UINT32_MAX) {
+               throw std::length_error("ParameterCodec: inline buffer too large");
+            }
+         }
+      }
+   }
+
+   // Writes params into dst and returns the number of bytes used.
+   // dst must hold at least EncodedSize(params, pool) bytes. Buffers living in pool are
+   // written as handles and retained once for the receiver, which adopts that reference.
+   // Everything that can throw is checked before the first byte is written or retained, so
+   // a params that passed Validate() never throws here.
+   static size_t Encode(const ParameterPack& params, unsigned char* dst, size_t capacity,
+      ISharedBufferPool* pool = nullptr) {
+      Validate(params, pool);
+      if (EncodedSize(params, pool) > capacity) {
+         throw std::length_error("ParameterCodec: encoded parameters exceed buffer");
+      }
+
+      unsigned char* out = dst;
+      *out++ = Version;
+      out = Put(out, static_cast<uint16_t>(params.size()));
+
+      for (const auto& param : params) {
+         switch (param.index()) {
+         case 0:
+            *out++ = TagInt;
+            out = Put(out, static_cast<int32_t>(std::get<int>(param)));
+            break;
+         case 1:
+            *out++ = TagFloat;
+            out = Put(out, std::get<float>(param));
+            break;
+         case 2:
+            *out++ = TagDouble;
+            out = Put(out, std::get<double>(param));
+            break;
+         case 3: {
+            const std::string& value = std::get<std::string>(param);
+            *out++ = TagString;
+            out = Put(out, static_cast<uint32_t>(value.size()));
+            memcpy(out, value.data(), value.size());
+            out += value.size();
+            break;
+         }
+         default: {
+            const SharedBuffer& buffer = std::get<SharedBuffer>(param);
+            if (IsPooled(buffer, pool)) {
+               *out++ = TagBufferRef;
+               out = Put(out, buffer.Handle());
+               out = Put(out, static_cast<uint64_t>(buffer.Size()));
+               pool->Retain(buffer.Handle());
+            }
+            else {
+               *out++ = TagBuffer;
+               out = Put(out, static_cast<uint32_t>(buffer.Size()));
+               if (buffer.Size() > 0) {
+                  memcpy(out, buffer.Data(), buffer.Size());
+               }
+               out += buffer.Size();
+            }
+            break;
+         }
+         }
+      }
+      return static_cast<size_t>(out - dst);
+   }
+
+   // Returns false (leaving params in an unspecified state) on a version mismatch or a
+   // truncated/corrupt buffer, so a bad message is dropped rather than misread.
+   // BufferRef parameters are adopted from pool without copying the bytes.
+   static bool Decode(const unsigned char* src, size_t size, ParameterPack& params,
+      ISharedBufferPool* pool = nullptr) {
+      const unsigned char* in = src;
+      const unsigned char* end = src + size;
+      params.clear();
+
+      uint16_t count = 0;
+      if (size < HeaderSize || *in++ != Version || !Get(in, end, count)) {
+         return false;
+      }
+      params.reserve(count);
+
+      for (uint16_t i = 0; i < count; ++i) {
+         if (in >= end) {
+            return false;
+         }
+         switch (*in++) {
+         case TagInt: {
+            int32_t value;
+            if (!Get(in, end, value)) return false;
+            params.emplace_back(std::in_place_index<0>, value);
+            break;
+         }
+         case TagFloat: {
+            float value;
+            if (!Get(in, end, value)) return false;
+            params.emplace_back(std::in_place_index<1>, value);
+            break;
+         }
+         case TagDouble: {
+            double value;
+            if (!Get(in, end, value)) return false;
+            params.emplace_back(std::in_place_index<2>, value);
+            break;
+         }
+         case TagString: {
+            uint32_t length;
+            if (!Get(in, end, length) || static_cast<size_t>(end - in) < length) return false;
+            params.emplace_back(std::in_place_index<3>, reinterpret_cast<const char*>(in), length);
+            in += length;
+            break;
+         }
+         case TagBuffer: {
+            uint32_t length;
+            if (!Get(in, end, length) || static_cast<size_t>(end - in) < length) return false;
+            params.emplace_back(std::in_place_index<4>, in, length);
+            in += length;
+            break;
+         }
+         case TagBufferRef: {
+            uint64_t handle, length;
+            if (!pool || !Get(in, end, handle) || !Get(in, end, length)) return false;
+            SharedBuffer buffer = pool->Adopt(handle, static_cast<size_t>(length));
+            if (buffer.Size() != length) return false;
+            params.emplace_back(std::in_place_index<4>, std::move(buffer));
+            break;
+         }
+         default:
+            return false;
+         }
+      }
+      return true;
+   }
+
+private:
+   static constexpr size_t HeaderSize = 1 + sizeof(uint16_t);
+
+   static bool IsPooled(const SharedBuffer& buffer, const ISharedBufferPool* pool) {
+      return pool != nullptr && buffer.Pool() == pool;
+   }
+
+   template<typename T>
+   static unsigned char* Put(unsigned char* out, T value) {
+      memcpy(out, &value, sizeof(T));
+      return out + sizeof(T);
+   }
+
+   template<typename T>
+   static bool Get(const unsigned char*& in, const unsigned char* end, T& value) {
+      if (static_cast<size_t>(end - in) < sizeof(T)) {
+         return false;
+      }
+      memcpy(&value, in, sizeof(T));
+      in += sizeof(T);
+      return true;
+   }
+};
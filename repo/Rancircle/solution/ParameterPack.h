@@ -0,0 +1,174 @@
+#pragma once
+#include <cstddef>
+#include <initializer_list>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Parameter list with room for InlineCapacity elements inside the object itself.
+// Messages with up to InlineCapacity parameters never touch the heap for the list; longer
+// lists spill to a heap array. Moving a pack moves its elements, so a pack built by the
+// producer travels to the handler without copying the parameters.
+template<typename T, size_t InlineCapacity>
+class BasicParameterPack {
+public:
+   using value_type = T;
+   using iterator = T*;
+   using const_iterator = const T*;
+
+   BasicParameterPack() noexcept : items(InlineItems()), count(0), capacity(InlineCapacity) {}
+
+   BasicParameterPack(std::initializer_list<T> values) : BasicParameterPack() {
+      Assign(values.begin(), values.size());
+   }
+
+   // Accepts the std::vector lists of older call sites
+   BasicParameterPack(const std::vector<T>& values) : BasicParameterPack() {
+      Assign(values.data(), values.size());
+   }
+
+   BasicParameterPack(const BasicParameterPack& other) : BasicParameterPack() {
+      Assign(other.items, other.count);
+   }
+
+   BasicParameterPack(BasicParameterPack&& other) noexcept : BasicParameterPack() {
+      MoveFrom(other);
+   }
+
+   BasicParameterPack& operator=(const BasicParameterPack& other) {
+      if (this != &other) {
+         clear();
+         Assign(other.items, other.count);
+      }
+      return *this;
+   }
+
+   BasicParameterPack& operator=(BasicParameterPack&& other) noexcept {
+      if (this != &other) {
+         clear();
+         ReleaseHeap();
+         MoveFrom(other);
+      }
+      return *this;
+   }
+
+   ~BasicParameterPack() {
+      clear();
+      ReleaseHeap();
+   }
+
+   // Copies into a std::vector, so handlers written against std::vector still bind
+   operator std::vector<T>() const { return std::vector<T>(begin(), end()); }
+
+   template<typename... Args>
+   T& emplace_back(Args&&... args) {
+      if (count == capacity) {
+         // Build the new element first: args may refer to an element being relocated
+         size_t grown = capacity * 2;
+         T* next = static_cast<T*>(::operator new(grown * sizeof(T)));
+         try {
+            new (next + count) T(std::forward<Args>(args)...);
+         }
+         catch (...) {
+            ::operator delete(next);
+            throw;
+         }
+         Relocate(next, grown);
+         return items[count++];
+      }
+      T* item = new (items + count) T(std::forward<Args>(args)...);
+      ++count;
+      return *item;
+   }
+
+   void push_back(const T& value) { emplace_back(value); }
+   void push_back(T&& value) { emplace_back(std::move(value)); }
+
+   void reserve(size_t size) {
+      if (size > capacity) {
+         Relocate(static_cast<T*>(::operator new(size * sizeof(T))), size);
+      }
+   }
+
+   void clear() noexcept {
+      for (size_t i = 0; i < count; ++i) {
+         items[i].~T();
+      }
+      count = 0;
+   }
+
+   size_t size() const { return count; }
+   bool empty() const { return count == 0; }
+   bool IsInline() const { return items == reinterpret_cast<const T*>(storage); }
+
+   T* data() { return items; }
+   const T* data() const { return items; }
+   T& operator[](size_t index) { return items[index]; }
+   const T& operator[](size_t index) const { return items[index]; }
+   T& front() { return items[0]; }
+   const T& front() const { return items[0]; }
+   T& back() { return items[count - 1]; }
+   const T& back() const { return items[count - 1]; }
+
+   iterator begin() { return items; }
+   iterator end() { return items + count; }
+   const_iterator begin() const { return items; }
+   const_iterator end() const { return items + count; }
+
+private:
+   static_assert(InlineCapacity > 0, "BasicParameterPack needs inline room for at least one element");
+   static_assert(std::is_nothrow_move_constructible_v<T>, "BasicParameterPack relocates elements by move");
+
+   T* InlineItems() { return reinterpret_cast<T*>(storage); }
+
+   void Assign(const T* values, size_t size) {
+      reserve(size);
+      for (size_t i = 0; i < size; ++i) {
+         new (items + i) T(values[i]);
+         count = i + 1;
+      }
+   }
+
+   // Moves the elements into next (capacity newCapacity) and frees the old heap array
+   void Relocate(T* next, size_t newCapacity) noexcept {
+      for (size_t i = 0; i < count; ++i) {
+         new (next + i) T(std::move(items[i]));
+         items[i].~T();
+      }
+      ReleaseHeap();
+      items = next;
+      capacity = newCapacity;
+   }
+
+   void ReleaseHeap() noexcept {
+      if (!IsInline()) {
+         ::operator delete(items);
+         items = InlineItems();
+         capacity = InlineCapacity;
+      }
+   }
+
+   // Called on an empty pack with inline storage
+   void MoveFrom(BasicParameterPack& other) noexcept {
+      if (other.IsInline()) {
+         for (size_t i = 0; i < other.count; ++i) {
+            new (items + i) T(std::move(other.items[i]));
+         }
+         count = other.count;
+         other.clear();
+         return;
+      }
+      items = other.items;
+      count = other.count;
+      capacity = other.capacity;
+      other.items = other.InlineItems();
+      other.count = 0;
+      other.capacity = InlineCapacity;
+   }
+
+   alignas(T) unsigned char storage[InlineCapacity * sizeof(T)];
+   T* items;
+   size_t count;
+   size_t capacity;
+};
\ No newline at end of file
@@ -0,0 +1,184 @@
+#include "PendingRequestTable.h"
+
+PendingRequestTable::PendingRequestTable(size_t capacity)
+   : entries(capacity == 0 ? 1 : capacity), stopping(false)
+{
+   freeList.reserve(entries.size() * 2);
+   for (size_t i = entries.size(); i > 0; --i) {
+      freeList.push_back(static_cast<uint32_t>(i - 1));
+   }
+}
+
+PendingRequestTable::~PendingRequestTable() {
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+   }
+   timerCondition.notify_all();
+   if (timerThread.joinable()) {
+      timerThread.join();
+   }
+
+   auto error = std::make_exception_ptr(RequestFailedException("Message queue destroyed"));
+   for (Entry& entry : entries) {
+      if (entry.promise) {
+         entry.promise->setException(error);
+      }
+   }
+}
+
+uint64_t PendingRequestTable::Add(std::chrono::milliseconds timeout, ReplyFuture& future) {
+   CallbackPromise<Reply> promise(ThreadPoolExecutor::shared());
+   future = promise.getFuture();
+
+   std::lock_guard<std::mutex> lock(mutex);
+   uint32_t index;
+   if (freeList.empty()) {
+      index = static_cast<uint32_t>(entries.size());
+      entries.emplace_back();
+   }
+   else {
+      index = freeList.back();
+      freeList.pop_back();
+   }
+   Entry& entry = entries[index];
+   entry.promise.emplace(std::move(promise));
+   uint64_t correlation = (static_cast<uint64_t>(entry.generation) << 32) | (static_cast<uint64_t>(index) + 1);
+
+   if (timeout.count() > 0) {
+      entry.deadline = std::chrono::steady_clock::now() + timeout;
+      Schedule(index);
+      bool earliest = entry.heapPos == 0;
+      if (!timerThread.joinable()) {
+         timerThread = std::thread(&PendingRequestTable::ExpireRequests, this);
+      }
+      else if (earliest) {
+         timerCondition.notify_one();
+      }
+   }
+   return correlation;
+}
+
+std::optional<CallbackPromise<PendingRequestTable::Reply>> PendingRequestTable::Take(uint64_t correlation) {
+   uint64_t index = (correlation & 0xFFFFFFFFu);
+   std::lock_guard<std::mutex> lock(mutex);
+   if (index == 0 || index > entries.size()) {
+      return std::nullopt;
+   }
+   Entry& entry = entries[index - 1];
+   if (!entry.promise || entry.generation != static_cast<uint32_t>(correlation >> 32)) {
+      return std::nullopt;
+   }
+   return Release(static_cast<uint32_t>(index - 1));
+}
+
+CallbackPromise<PendingRequestTable::Reply> PendingRequestTable::Release(uint32_t index) {
+   Entry& entry = entries[index];
+   CallbackPromise<Reply> promise = std::move(*entry.promise);
+   entry.promise.reset();
+   ++entry.generation;
+   if (entry.heapPos != NotScheduled) {
+      Unschedule(index);
+   }
+   freeList.push_back(index);
+   return promise;
+}
+
+bool PendingRequestTable::Complete(uint64_t correlation, Reply reply) {
+   auto promise = Take(correlation);
+   if (!promise) {
+      return false;
+   }
+   // Outside the lock: the future's continuation may run here
+   promise->setValue(std::move(reply));
+   return true;
+}
+
+bool PendingRequestTable::Fail(uint64_t correlation, std::exception_ptr error) {
+   auto promise = Take(correlation);
+   if (!promise) {
+      return false;
+   }
+   promise->setException(std::move(error));
+   return true;
+}
+
+void PendingRequestTable::ExpireRequests() {
+   std::unique_lock<std::mutex> lock(mutex);
+   while (!stopping) {
+      if (deadlines.empty()) {
+         timerCondition.wait(lock);
+         continue;
+      }
+      auto when = entries[deadlines.front()].deadline;
+      if (std::chrono::steady_clock::now() < when) {
+         timerCondition.wait_until(lock, when);
+         continue;
+      }
+
+      // Completed requests already left the heap, so the top is a genuine timeout
+      CallbackPromise<Reply> promise = Release(deadlines.front());
+      lock.unlock();
+      promise.setException(std::make_exception_ptr(RequestTimeoutException()));
+      lock.lock();
+   }
+}
+
+void PendingRequestTable::Schedule(uint32_t index) {
+   deadlines.push_back(index);
+   entries[index].heapPos = deadlines.size() - 1;
+   SiftUp(deadlines.size() - 1);
+}
+
+void PendingRequestTable::Unschedule(uint32_t index) {
+   size_t pos = entries[index].heapPos;
+   entries[index].heapPos = NotScheduled;
+   uint32_t last = deadlines.back();
+   deadlines.pop_back();
+   if (pos == deadlines.size()) {
+      return; // it was the last element
+   }
+   Place(pos, last);
+   SiftUp(pos);
+   SiftDown(entries[last].heapPos);
+}
+
+bool PendingRequestTable::Earlier(size_t a, size_t b) const {
+   return entries[deadlines[a]].deadline < entries[deadlines[b]].deadline;
+}
+
+void PendingRequestTable::Place(size_t pos, uint32_t index) {
+   deadlines[pos] = index;
+   entries[index].heapPos = pos;
+}
+
+void PendingRequestTable::SiftUp(size_t pos) {
+   while (pos > 0) {
+      size_t parent = (pos - 1) / 2;
+      if (!Earlier(pos, parent)) {
+         break;
+      }
+      uint32_t index = deadlines[pos];
+      Place(pos, deadlines[parent]);
+      Place(parent, index);
+      pos = parent;
+   }
+}
+
+void PendingRequestTable::SiftDown(size_t pos) {
+   for (;;) {
+      size_t smallest = pos;
+      for (size_t child = 2 * pos + 1; child <= 2 * pos + 2 && child < deadlines.size(); ++child) {
+         if (Earlier(child, smallest)) {
+            smallest = child;
+         }
+      }
+      if (smallest == pos) {
+         return;
+      }
+      uint32_t index = deadlines[pos];
+      Place(pos, deadlines[smallest]);
+      Place(smallest, index);
+      pos = smallest;
+   }
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "messageQueue.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+class RequestTimeoutException : public std::runtime_error {
+public:
+   RequestTimeoutException() : std::runtime_error("Request timed out") {}
+};
+
+// The request could not be served: no request handler, the handler threw, or the queue went away
+class RequestFailedException : public std::runtime_error {
+public:
+   explicit RequestFailedException(const std::string& what) : std::runtime_error(what) {}
+};
+
+// Outstanding requests of one queue, keyed by correlation id.
+// Entries are recycled through a free list; a correlation id is (generation << 32) | (index + 1),
+// so completing a request is an index lookup plus a generation check, and a late reply for
+// an entry that already timed out (and was reused) is ignored. The table starts with
+// capacity entries and only grows past that under a burst of outstanding requests;
+// completion never allocates, the reply is moved into the future.
+// Deadlines are tracked by a timer thread started on the first request with a timeout. They
+// sit in a min-heap of entry indices that each entry knows its position in, so a request that
+// completes removes its deadline right away and only requests that really time out are
+// seen by the timer.
+class PendingRequestTable {
+public:
+   using Reply = IMessageQueue::Reply;
+   using ReplyFuture = IMessageQueue::ReplyFuture;
+
+   explicit PendingRequestTable(size_t capacity = 4096);
+   ~PendingRequestTable();
+
+   PendingRequestTable(const PendingRequestTable&) = delete;
+   PendingRequestTable& operator=(const PendingRequestTable&) = delete;
+
+   // Reserves an entry and returns its correlation id (never 0); future receives the reply.
+   // A timeout of zero or less waits forever.
+   uint64_t Add(std::chrono::milliseconds timeout, ReplyFuture& future);
+
+   // Both return false when the id is unknown, already completed or timed out
+   bool Complete(uint64_t correlation, Reply reply);
+   bool Fail(uint64_t correlation, std::exception_ptr error);
+
+private:
+   static constexpr size_t NotScheduled = SIZE_MAX;
+
+   struct Entry {
+      uint32_t generation = 0;
+      std::optional<CallbackPromise<Reply>> promise;
+      std::chrono::steady_clock::time_point deadline;
+      size_t heapPos = NotScheduled; // position in deadlines, or NotScheduled
+   };
+
+   std::optional<CallbackPromise<Reply>> Take(uint64_t correlation);
+   // Called with mutex held: frees the entry and returns its promise
+   CallbackPromise<Reply> Release(uint32_t index);
+   void ExpireRequests();
+
+   // Deadline heap operations, called with mutex held
+   void Schedule(uint32_t index);
+   void Unschedule(uint32_t index);
+   bool Earlier(size_t a, size_t b) const;
+   void Place(size_t pos, uint32_t index);
+   void SiftUp(size_t pos);
+   void SiftDown(size_t pos);
+
+   std::mutex mutex;
+   std::deque<Entry> entries; // deque: growing keeps existing entries in place
+   std::vector<uint32_t> freeList;
+
+   std::vector<uint32_t> deadlines; // min-heap of entry indices ordered by Entry::deadline
+   std::condition_variable timerCondition;
+   std::thread timerThread;
+   bool stopping;
+};
\ No newline at end of file
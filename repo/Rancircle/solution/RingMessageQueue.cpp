@@ -0,0 +1,358 @@
+#include "RingMessageQueue.h"
+
+namespace {
+   size_t RoundUpToPowerOfTwo(size_t value) {
+      size_t result = 2;
+      while (result < value) {
+         result <<= 1;
+      }
+      return result;
+   }
+}
+
+RingMessageQueue::RingMessageQueue(size_t numThreads, size_t queueCapacity, BackpressurePolicy fullPolicy)
+   : capacity(RoundUpToPowerOfTwo(queueCapacity)), mask(capacity - 1), enqueuePos(0), dequeuePos(0),
+     policy(fullPolicy), dropped(0), parkedWorkers(0), parkedProducers(0),
+     running(false), threadCount(numThreads), batchSize(DefaultBatchSize)
+{
+   handlers.SetMetrics(&metrics);
+   slots.reset(new Slot[capacity]);
+   for (size_t i = 0; i < capacity; ++i) {
+      slots[i].sequence.store(i, std::memory_order_relaxed);
+   }
+}
+
+RingMessageQueue::~RingMessageQueue() {
+   Stop();
+}
+
+void RingMessageQueue::Start() {
+   std::lock_guard<std::mutex> resize(resizeMutex);
+   if (!running) {
+      running = true;
+      ResizeWorkers(threadCount);
+   }
+}
+
+void RingMessageQueue::Stop() {
+   std::lock_guard<std::mutex> resize(resizeMutex);
+   if (running) {
+      {
+         std::lock_guard<std::mutex> lock(parkMutex);
+         running = false;
+      }
+      notEmpty.notify_all();
+      notFull.notify_all();
+
+      for (auto& worker : workers) {
+         if (worker->thread->joinable()) {
+            worker->thread->join();
+         }
+      }
+      workers.clear();
+      handlers.WaitForFanOuts(); // handlers the workers fanned out to an executor
+   }
+}
+
+void RingMessageQueue::SetThreadCount(size_t numThreads) {
+   std::lock_guard<std::mutex> resize(resizeMutex);
+   if (running) {
+      ResizeWorkers(numThreads);
+   }
+   threadCount = numThreads;
+}
+
+void RingMessageQueue::SetWorkerPlacement(const WorkerPlacement& workerPlacement) {
+   std::lock_guard<std::mutex> resize(resizeMutex);
+   placement = workerPlacement;
+   for (size_t i = 0; i < workers.size(); ++i) {
+      placement.Apply(*workers[i]->thread, i);
+   }
+}
+
+// Called with resizeMutex held while running. The newest workers are retired and joined
+// once they finish the batch they are dispatching.
+void RingMessageQueue::ResizeWorkers(size_t count) {
+   while (workers.size() < count) {
+      auto worker = std::make_unique<Worker>();
+      worker->thread = std::make_unique<std::thread>(&RingMessageQueue::ProcessMessages, this, std::cref(worker->retire));
+      if (!placement.Empty()) {
+         placement.Apply(*worker->thread, workers.size());
+      }
+      workers.push_back(std::move(worker));
+   }
+   if (workers.size() > count) {
+      {
+         std::lock_guard<std::mutex> lock(parkMutex);
+         for (size_t i = count; i < workers.size(); ++i) {
+            workers[i]->retire = true;
+         }
+      }
+      notEmpty.notify_all();
+      for (size_t i = count; i < workers.size(); ++i) {
+         workers[i]->thread->join();
+      }
+      workers.resize(count);
+   }
+}
+
+void RingMessageQueue::EnableMetrics(bool enabled) {
+   metrics.Enable(enabled);
+}
+
+MetricsSnapshot RingMessageQueue::SnapshotMetrics() const {
+   return metrics.Snapshot();
+}
+
+void RingMessageQueue::RegisterHandler(MessageId id, MessageHandler handler) {
+   handlers.Add(id, std::move(handler));
+}
+
+void RingMessageQueue::RegisterRequestHandler(MessageId id, RequestHandler handler) {
+   handlers.AddRequestHandler(id, std::move(handler));
+}
+
+void RingMessageQueue::RegisterBatchHandler(MessageId id, BatchHandler handler) {
+   handlers.AddBatch(id, std::move(handler));
+}
+
+void RingMessageQueue::SetBatchSize(size_t maxMessages) {
+   batchSize.store(maxMessages == 0 ? 1 : maxMessages, std::memory_order_relaxed);
+}
+
+void RingMessageQueue::RegisterPayloadHandler(MessageId id, PayloadHandler handler) {
+   handlers.AddPayload(id, std::move(handler));
+}
+
+void RingMessageQueue::SetFanOut(MessageId id, bool parallel, JoinHandler onJoin, std::shared_ptr<IExecutor> executor) {
+   handlers.SetFanOut(id, parallel, std::move(onJoin), std::move(executor));
+}
+
+bool RingMessageQueue::TryEnqueue(Message& msg) {
+   size_t pos = enqueuePos.load(std::memory_order_relaxed);
+   for (;;) {
+      Slot& slot = slots[pos & mask];
+      size_t seq = slot.sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+         if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            slot.msg = std::move(msg);
+            slot.sequence.store(pos + 1, std::memory_order_release);
+            return true;
+         }
+      }
+      else if (diff < 0) {
+         return false; // full
+      }
+      else {
+         pos = enqueuePos.load(std::memory_order_relaxed);
+      }
+   }
+}
+
+bool RingMessageQueue::TryDequeue(Message& msg) {
+   size_t pos = dequeuePos.load(std::memory_order_relaxed);
+   for (;;) {
+      Slot& slot = slots[pos & mask];
+      size_t seq = slot.sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+         if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            msg = std::move(slot.msg);
+            slot.sequence.store(pos + mask + 1, std::memory_order_release);
+            return true;
+         }
+      }
+      else if (diff < 0) {
+         return false; // empty
+      }
+      else {
+         pos = dequeuePos.load(std::memory_order_relaxed);
+      }
+   }
+}
+
+void RingMessageQueue::WakeWorker() {
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   if (parkedWorkers.load(std::memory_order_relaxed) > 0) {
+      std::lock_guard<std::mutex> lock(parkMutex);
+      notEmpty.notify_one();
+   }
+}
+
+// A drained batch may free room for several blocked producers
+void RingMessageQueue::WakeProducers(size_t freed) {
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   if (parkedProducers.load(std::memory_order_relaxed) > 0) {
+      std::lock_guard<std::mutex> lock(parkMutex);
+      if (freed > 1) {
+         notFull.notify_all();
+      }
+      else {
+         notFull.notify_one();
+      }
+   }
+}
+
+// Returns false if the queue stopped while waiting; the caller then gives up on the message
+bool RingMessageQueue::WaitForSpace() {
+   for (int spin = 0; spin < SpinCount; ++spin) {
+      if (enqueuePos.load() - dequeuePos.load() < capacity) {
+         return true;
+      }
+      std::this_thread::yield();
+   }
+
+   std::unique_lock<std::mutex> lock(parkMutex);
+   parkedProducers.fetch_add(1);
+   notFull.wait(lock, [this] {
+      return enqueuePos.load() - dequeuePos.load() < capacity || !running;
+      });
+   parkedProducers.fetch_sub(1);
+   return running;
+}
+
+void RingMessageQueue::QueueMessageImpl(MessageId id, ParameterPack&& params) {
+   Message msg{ id, std::move(params) };
+   Enqueue(msg);
+}
+
+void RingMessageQueue::QueuePayloadImpl(MessageId id, MessagePayload&& payload) {
+   Message msg{ id };
+   msg.payload = std::move(payload);
+   Enqueue(msg);
+}
+
+// Each message still claims its own slot, but the batch pays for a single wakeup
+void RingMessageQueue::QueueMessagesImpl(const BatchMessage* messages, size_t count) {
+   bool inserted = false;
+   try {
+      for (size_t i = 0; i < count; ++i) {
+         Message msg{ messages[i].id, messages[i].params };
+         inserted = Insert(msg) || inserted;
+      }
+   }
+   catch (...) {
+      if (inserted) {
+         WakeWorker();
+      }
+      throw;
+   }
+   if (inserted) {
+      WakeWorker();
+   }
+}
+
+// Backpressure applies to requests too; a dropped or rejected request fails its future
+RingMessageQueue::ReplyFuture RingMessageQueue::RequestImpl(MessageId id, ParameterPack&& params,
+   std::chrono::milliseconds timeout) {
+   ReplyFuture future;
+   Message msg{ id, std::move(params), pending.Add(timeout, future) };
+   uint64_t correlation = msg.correlation;
+   try {
+      Enqueue(msg);
+   }
+   catch (...) {
+      pending.Fail(correlation, std::current_exception());
+   }
+   return future;
+}
+
+// Counts a message lost to backpressure and fails it if it was a request
+void RingMessageQueue::Discard(Message& msg) {
+   dropped.fetch_add(1, std::memory_order_relaxed);
+   if (metrics.Enabled()) {
+      metrics.Dropped(msg.id);
+   }
+   if (msg.correlation != 0) {
+      pending.Fail(msg.correlation, std::make_exception_ptr(QueueFullException()));
+   }
+}
+
+void RingMessageQueue::Enqueue(Message& msg) {
+   if (Insert(msg)) {
+      WakeWorker();
+   }
+}
+
+// Applies the backpressure policy without waking a worker.
+// Returns false if the policy dropped msg.
+bool RingMessageQueue::Insert(Message& msg) {
+   bool recording = metrics.Enabled();
+   if (recording) {
+      msg.enqueuedAt = MetricsRegistry::Clock::now();
+      metrics.Enqueued(msg.id);
+   }
+   while (!TryEnqueue(msg)) {
+      switch (policy) {
+      case BackpressurePolicy::Block:
+         WakeWorker(); // a batch in progress has not woken anyone yet
+         if (!WaitForSpace()) {
+            if (recording) {
+               metrics.Dropped(msg.id);
+            }
+            throw QueueFullException();
+         }
+         break;
+      case BackpressurePolicy::DropNewest:
+         Discard(msg);
+         return false;
+      case BackpressurePolicy::DropOldest: {
+         Message evicted;
+         if (TryDequeue(evicted)) {
+            Discard(evicted);
+         }
+         break;
+      }
+      case BackpressurePolicy::Fail:
+         if (recording) {
+            metrics.Dropped(msg.id);
+         }
+         throw QueueFullException();
+      }
+   }
+   return true;
+}
+
+void RingMessageQueue::ProcessMessages(const std::atomic<bool>& retire) {
+   Message msg;
+   std::vector<Message> drained;
+   HandlerRegistry::Run run;
+   while (!retire.load(std::memory_order_relaxed)) {
+      bool received = false;
+      for (int spin = 0; spin < SpinCount && !(received = TryDequeue(msg)); ++spin) {
+         std::this_thread::yield();
+      }
+
+      if (!received) {
+         std::unique_lock<std::mutex> lock(parkMutex);
+         parkedWorkers.fetch_add(1);
+         notEmpty.wait(lock, [this, &retire] {
+            return !running || retire.load() || enqueuePos.load() != dequeuePos.load();
+            });
+         parkedWorkers.fetch_sub(1);
+
+         if (!running && enqueuePos.load() == dequeuePos.load()) {
+            break;
+         }
+         continue;
+      }
+
+      // Drain up to batchSize messages for this wakeup
+      size_t limit = batchSize.load(std::memory_order_relaxed);
+      drained.push_back(std::move(msg));
+      while (drained.size() < limit && TryDequeue(msg)) {
+         drained.push_back(std::move(msg));
+      }
+
+      WakeProducers(drained.size());
+      if (enqueuePos.load() != dequeuePos.load()) {
+         WakeWorker(); // leftovers: let a parked worker help
+      }
+
+      handlers.DispatchDrained(drained, run, [this](Message& request) {
+         handlers.Respond(request.id, request.params, pending, request.correlation);
+         });
+      drained.clear();
+   }
+}
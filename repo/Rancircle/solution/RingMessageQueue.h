@@ -0,0 +1,122 @@
+#pragma once
+#include "messageQueue.h"
+#include "HandlerRegistry.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <stdexcept>
+
+// What QueueMessage does when the ring is full
+enum class BackpressurePolicy {
+   Block,       // wait (spin, then park) until a worker frees a slot
+   DropNewest,  // discard the message being queued
+   DropOldest,  // evict the oldest queued message to make room
+   Fail         // throw QueueFullException
+};
+
+class QueueFullException : public std::runtime_error {
+public:
+   QueueFullException() : std::runtime_error("Message queue is full") {}
+};
+
+// Bounded lock-free MPMC ring (sequence-numbered slots) as an alternative backend to
+// LocalMessageQueue. Slots are preallocated; producers and workers only contend on
+// the ring indices, and workers spin briefly before parking so a busy queue never
+// pays for a condition variable notify.
+class RingMessageQueue : public IMessageQueue {
+public:
+   explicit RingMessageQueue(size_t numThreads = 1, size_t queueCapacity = 1024,
+      BackpressurePolicy fullPolicy = BackpressurePolicy::Block);
+   ~RingMessageQueue();
+
+   void Start() override;
+   void Stop() override;
+   // Adds or retires workers while running; queued messages keep flowing.
+   // Must not be called from a handler.
+   void SetThreadCount(size_t numThreads) override;
+   void RegisterHandler(MessageId id, MessageHandler handler) override;
+   void RegisterRequestHandler(MessageId id, RequestHandler handler) override;
+   void RegisterBatchHandler(MessageId id, BatchHandler handler) override;
+   void SetBatchSize(size_t maxMessages) override;
+   void RegisterPayloadHandler(MessageId id, PayloadHandler handler) override;
+   void SetFanOut(MessageId id, bool parallel, JoinHandler onJoin,
+      std::shared_ptr<IExecutor> executor = nullptr) override;
+   void SetWorkerPlacement(const WorkerPlacement& workerPlacement) override;
+   // Messages lost to backpressure count as dropped
+   void EnableMetrics(bool enabled) override;
+   MetricsSnapshot SnapshotMetrics() const override;
+
+   size_t Capacity() const { return capacity; }
+   size_t DroppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+protected:
+   void QueueMessageImpl(MessageId id, ParameterPack&& params) override;
+   void QueueMessagesImpl(const BatchMessage* messages, size_t count) override;
+   ReplyFuture RequestImpl(MessageId id, ParameterPack&& params, std::chrono::milliseconds timeout) override;
+   void QueuePayloadImpl(MessageId id, MessagePayload&& payload) override;
+   void ProcessMessages(const std::atomic<bool>& retire);
+
+private:
+   struct Worker {
+      std::unique_ptr<std::thread> thread;
+      std::atomic<bool> retire{ false };
+   };
+
+   // Built from { id, params[, correlation] }; the other fields keep their defaults
+   struct Message {
+      Message() = default;
+      Message(MessageId messageId, ParameterPack parameters = ParameterPack(), uint64_t correlationId = 0)
+         : id(messageId), params(std::move(parameters)), correlation(correlationId) {}
+
+      MessageId id = 0;
+      ParameterPack params;
+      uint64_t correlation = 0; // non-zero for requests
+      MessagePayload payload;   // typed messages only
+      MetricsRegistry::Clock::time_point enqueuedAt; // set only while metrics are enabled
+   };
+
+   struct alignas(64) Slot {
+      std::atomic<size_t> sequence;
+      Message msg;
+   };
+
+   void Enqueue(Message& msg);
+   bool Insert(Message& msg);
+   void Discard(Message& msg);
+   bool TryEnqueue(Message& msg);
+   bool TryDequeue(Message& msg);
+   bool WaitForSpace();
+   void WakeWorker();
+   void WakeProducers(size_t freed);
+   void ResizeWorkers(size_t count);
+
+   static constexpr int SpinCount = 256;
+
+   std::unique_ptr<Slot[]> slots;
+   size_t capacity;
+   size_t mask;
+   alignas(64) std::atomic<size_t> enqueuePos;
+   alignas(64) std::atomic<size_t> dequeuePos;
+
+   BackpressurePolicy policy;
+   std::atomic<size_t> dropped;
+
+   MetricsRegistry metrics;
+   HandlerRegistry handlers;
+   PendingRequestTable pending;
+   std::vector<std::unique_ptr<Worker>> workers; // guarded by resizeMutex
+   std::mutex resizeMutex;
+   WorkerPlacement placement; // guarded by resizeMutex
+
+   // Parking lots for idle workers and for producers blocked on a full ring
+   std::mutex parkMutex;
+   std::condition_variable notEmpty;
+   std::condition_variable notFull;
+   std::atomic<size_t> parkedWorkers;
+   std::atomic<size_t> parkedProducers;
+
+   std::atomic<bool> running;
+   size_t threadCount;
+   std::atomic<size_t> batchSize;
+};
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+class SharedBuffer;
+
+// A pool that can hand SharedBuffer storage to another process by handle (see SharedMemorySlab)
+class ISharedBufferPool {
+public:
+   virtual ~ISharedBufferPool() = default;
+
+   // Adds one reference on behalf of a message that carries the handle to another process
+   virtual void Retain(uint64_t handle) = 0;
+
+   // Wraps a received handle, taking over the reference its message carried
+   virtual SharedBuffer Adopt(uint64_t handle, size_t size) = 0;
+};
+
+// Immutable, reference-counted byte buffer usable as a message parameter.
+// Copies share the bytes; a buffer backed by a shared-memory pool crosses an IPC queue as a
+// handle, so the receiving process reads the producer's bytes in place (zero-copy).
+class SharedBuffer {
+public:
+   class Storage {
+   public:
+      virtual ~Storage() = default;
+      virtual const unsigned char* Data() const = 0;
+      virtual size_t Size() const = 0;
+
+      // Non-null when the bytes live in a pool that can export them by handle
+      virtual ISharedBufferPool* Pool() const { return nullptr; }
+      virtual uint64_t Handle() const { return 0; }
+   };
+
+   SharedBuffer() = default;
+
+   explicit SharedBuffer(std::vector<unsigned char> bytes)
+      : storage(std::make_shared<HeapStorage>(std::move(bytes))) {}
+
+   SharedBuffer(const void* data, size_t size)
+      : storage(std::make_shared<HeapStorage>(std::vector<unsigned char>(
+         static_cast<const unsigned char*>(data), static_cast<const unsigned char*>(data) + size))) {}
+
+   explicit SharedBuffer(std::shared_ptr<const Storage> backing) : storage(std::move(backing)) {}
+
+   const unsigned char* Data() const { return storage ? storage->Data() : nullptr; }
+   size_t Size() const { return storage ? storage->Size() : 0; }
+   bool Empty() const { return Size() == 0; }
+
+   ISharedBufferPool* Pool() const { return storage ? storage->Pool() : nullptr; }
+   uint64_t Handle() const { return storage ? storage->Handle() : 0; }
+
+   friend bool operator==(const SharedBuffer& a, const SharedBuffer& b) {
+      return a.Size() == b.Size()
+         && (a.Size() == 0 || a.Data() == b.Data() || memcmp(a.Data(), b.Data(), a.Size()) == 0);
+   }
+   friend bool operator!=(const SharedBuffer& a, const SharedBuffer& b) { return !(a == b); }
+
+private:
+   class HeapStorage final : public Storage {
+   public:
+      explicit HeapStorage(std::vector<unsigned char> data) : bytes(std::move(data)) {}
+      const unsigned char* Data() const override { return bytes.data(); }
+      size_t Size() const override { return bytes.size(); }
+   private:
+      std::vector<unsigned char> bytes;
+   };
+
+   std::shared_ptr<const Storage> storage;
+};
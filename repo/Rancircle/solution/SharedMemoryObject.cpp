@@ -0,0 +1,66 @@
+#include "SharedMemoryObject.h"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <chrono>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+   constexpr int AttachRetries = 1000; // x 1 ms while another process initializes the object
+}
+
+std::string shm::ObjectName(const std::string& name) {
+   std::string objectName = "/" + name;
+   for (size_t i = 1; i < objectName.size(); ++i) {
+      if (objectName[i] == '/') objectName[i] = '_';
+   }
+   return objectName;
+}
+
+void* shm::MapObject(const std::string& objectName, size_t size, bool& creator, bool attachOnly) {
+   creator = !attachOnly;
+   int fd = attachOnly ? -1 : shm_open(objectName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+   if (fd == -1) {
+      if (!attachOnly && errno != EEXIST) return nullptr;
+      creator = false;
+      fd = shm_open(objectName.c_str(), O_RDWR, 0666);
+      if (fd == -1) return nullptr;
+
+      // Wait for the creating process to size the object
+      struct stat st {};
+      int retries = 0;
+      while (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) < size && ++retries < AttachRetries) {
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      if (static_cast<size_t>(st.st_size) != size) {
+         close(fd);
+         return nullptr;
+      }
+   }
+   else if (ftruncate(fd, static_cast<off_t>(size)) == -1) {
+      close(fd);
+      shm_unlink(objectName.c_str());
+      return nullptr;
+   }
+
+   void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if (mem == MAP_FAILED) {
+      if (creator) shm_unlink(objectName.c_str());
+      return nullptr;
+   }
+   return mem;
+}
+
+bool shm::WaitReady(const std::atomic<uint32_t>& state, uint32_t readyMagic) {
+   int retries = 0;
+   while (state.load(std::memory_order_acquire) != readyMagic && ++retries < AttachRetries) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   }
+   return state.load(std::memory_order_acquire) == readyMagic;
+}
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+
+#ifndef _WIN32
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Helpers shared by SharedMemoryRing and SharedMemorySlab for creating or attaching to a
+// named POSIX shared-memory object of a fixed size.
+namespace shm {
+   // Maps IPC queue names onto a valid shm_open name ("/name", no further slashes)
+   std::string ObjectName(const std::string& name);
+
+   // Creates (creator = true) or attaches to the object and maps size bytes of it.
+   // Attaching waits for the creator to size the object. With attachOnly a missing object
+   // is not created. Returns nullptr on failure.
+   void* MapObject(const std::string& objectName, size_t size, bool& creator, bool attachOnly = false);
+
+   // Waits for the creator to publish readyMagic in state; false on timeout
+   bool WaitReady(const std::atomic<uint32_t>& state, uint32_t readyMagic);
+
+   inline size_t AlignUp(size_t value, size_t alignment) {
+      return (value + alignment - 1) & ~(alignment - 1);
+   }
+
+   constexpr size_t CacheLine = 64;
+}
+#endif
@@ -0,0 +1,277 @@
+#include "SharedMemoryRing.h"
+
+#ifndef _WIN32
+#include "SharedMemoryObject.h"
+#include <thread>
+#include <climits>
+#include <cstring>
+#include <cstddef>
+#include <ctime>
+#include <new>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+struct SharedMemoryRing::Header {
+   static constexpr uint32_t ReadyMagic = 0x52494E47;   // "RING"
+   static constexpr uint32_t RetiredMagic = 0x44454144; // "DEAD"
+
+   std::atomic<uint32_t> state;
+   uint32_t slotCount;
+   uint32_t mask;
+   uint32_t payloadSize;
+
+   alignas(64) std::atomic<uint64_t> enqueuePos;
+   alignas(64) std::atomic<uint64_t> dequeuePos;
+
+   // Futex words: bumped by the other side when it sees a sleeper
+   alignas(64) std::atomic<uint32_t> itemsFutex;
+   std::atomic<uint32_t> itemsWaiters;
+   alignas(64) std::atomic<uint32_t> spaceFutex;
+   std::atomic<uint32_t> spaceWaiters;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+   "SharedMemoryRing needs address-free atomics to live in shared memory");
+
+namespace {
+   constexpr int SpinCount = 128;
+
+   uint32_t RoundUpToPowerOfTwo(uint32_t value) {
+      uint32_t result = 2;
+      while (result < value) {
+         result <<= 1;
+      }
+      return result;
+   }
+
+   // Shared (not FUTEX_PRIVATE) operations: the word lives in a MAP_SHARED mapping.
+   // timeout is relative; nullptr waits until woken.
+   void FutexWait(std::atomic<uint32_t>& word, uint32_t expected, const timespec* timeout = nullptr) {
+      syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, timeout, nullptr, 0);
+   }
+
+   void FutexWake(std::atomic<uint32_t>& word, int count) {
+      syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, count, nullptr, nullptr, 0);
+   }
+
+   void Signal(std::atomic<uint32_t>& word, std::atomic<uint32_t>& waiters) {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (waiters.load(std::memory_order_relaxed) > 0) {
+         word.fetch_add(1);
+         FutexWake(word, 1);
+      }
+   }
+}
+
+SharedMemoryRing::~SharedMemoryRing() {
+   Close(false);
+}
+
+bool SharedMemoryRing::Open(const std::string& name, uint32_t slotCount, uint32_t slotPayloadSize, bool attachOnly) {
+   if (IsOpen()) {
+      return true;
+   }
+
+   shmName = shm::ObjectName(name);
+
+   slotCount = RoundUpToPowerOfTwo(slotCount);
+   slotStride = shm::AlignUp(offsetof(Slot, data) + slotPayloadSize, shm::CacheLine);
+   size_t headerSize = shm::AlignUp(sizeof(Header), shm::CacheLine);
+   size_t totalSize = headerSize + slotStride * slotCount;
+
+   bool creator = false;
+   void* mem = shm::MapObject(shmName, totalSize, creator, attachOnly);
+   if (!mem) {
+      return false;
+   }
+
+   mappedSize = totalSize;
+   payloadSize = slotPayloadSize;
+   owner = creator;
+   slots = static_cast<unsigned char*>(mem) + headerSize;
+
+   if (creator) {
+      header = new (mem) Header();
+      header->slotCount = slotCount;
+      header->mask = slotCount - 1;
+      header->payloadSize = slotPayloadSize;
+      for (uint32_t i = 0; i < slotCount; ++i) {
+         new (slots + slotStride * i) Slot();
+         SlotAt(i)->sequence.store(i, std::memory_order_relaxed);
+      }
+      header->state.store(Header::ReadyMagic, std::memory_order_release);
+      return true;
+   }
+
+   header = static_cast<Header*>(mem);
+   if (!shm::WaitReady(header->state, Header::ReadyMagic)
+      || header->slotCount != slotCount || header->payloadSize != slotPayloadSize) {
+      Close(false);
+      return false;
+   }
+   return true;
+}
+
+void SharedMemoryRing::Close(bool unlink) {
+   if (header) {
+      if (unlink && owner) {
+         header->state.store(Header::RetiredMagic, std::memory_order_release);
+         WakeAll();
+      }
+      munmap(header, mappedSize);
+      header = nullptr;
+      slots = nullptr;
+      mappedSize = 0;
+      if (unlink && owner) {
+         shm_unlink(shmName.c_str());
+      }
+      owner = false;
+   }
+}
+
+bool SharedMemoryRing::IsRetired() const {
+   return header->state.load(std::memory_order_acquire) != Header::ReadyMagic;
+}
+
+void SharedMemoryRing::Retire(const std::string& name, uint32_t slotCount, uint32_t slotPayloadSize) {
+   SharedMemoryRing stale;
+   if (stale.Open(name, slotCount, slotPayloadSize, true)) {
+      stale.owner = true; // its creator is gone
+      stale.Close(true);
+   }
+   else {
+      shm_unlink(shm::ObjectName(name).c_str());
+   }
+}
+
+SharedMemoryRing::Slot* SharedMemoryRing::SlotAt(uint64_t pos) const {
+   return reinterpret_cast<Slot*>(slots + slotStride * (pos & header->mask));
+}
+
+bool SharedMemoryRing::Push(int32_t tag, const void* data, size_t size, const std::atomic<bool>& running,
+   Clock::time_point deadline) {
+   return Emplace(tag, size, [data, size](unsigned char* dst) {
+      if (size > 0) {
+         memcpy(dst, data, size);
+      }
+      }, running, deadline);
+}
+
+SharedMemoryRing::Slot* SharedMemoryRing::ClaimWrite(uint64_t& pos, const std::atomic<bool>& running,
+   Clock::time_point deadline) {
+   int spins = 0;
+   pos = header->enqueuePos.load(std::memory_order_relaxed);
+   for (;;) {
+      Slot* slot = SlotAt(pos);
+      uint64_t seq = slot->sequence.load(std::memory_order_acquire);
+      int64_t diff = static_cast<int64_t>(seq - pos);
+      if (diff == 0) {
+         if (header->enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            return slot;
+         }
+         continue;
+      }
+      if (diff > 0) {
+         pos = header->enqueuePos.load(std::memory_order_relaxed);
+         continue;
+      }
+
+      // Full: spin briefly, then sleep until a consumer releases a slot
+      if (++spins < SpinCount) {
+         std::this_thread::yield();
+      }
+      else {
+         // A retired ring is never drained again
+         if (IsRetired()) {
+            return nullptr;
+         }
+         timespec timeout{};
+         const timespec* wait = nullptr;
+         if (deadline != Clock::time_point::max()) {
+            auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - Clock::now()).count();
+            if (left <= 0) {
+               return nullptr;
+            }
+            timeout.tv_sec = static_cast<time_t>(left / 1000000000);
+            timeout.tv_nsec = static_cast<long>(left % 1000000000);
+            wait = &timeout;
+         }
+         uint32_t epoch = header->spaceFutex.load();
+         header->spaceWaiters.fetch_add(1);
+         bool stillFull = static_cast<int64_t>(slot->sequence.load() - pos) < 0;
+         if (stillFull && running.load()) {
+            FutexWait(header->spaceFutex, epoch, wait);
+         }
+         header->spaceWaiters.fetch_sub(1);
+         if (!running.load()) {
+            return nullptr;
+         }
+      }
+      pos = header->enqueuePos.load(std::memory_order_relaxed);
+   }
+}
+
+void SharedMemoryRing::PublishWrite(Slot* slot, uint64_t pos) {
+   slot->sequence.store(pos + 1, std::memory_order_release);
+   Signal(header->itemsFutex, header->itemsWaiters);
+}
+
+SharedMemoryRing::Slot* SharedMemoryRing::TryClaimRead(uint64_t& pos) {
+   pos = header->dequeuePos.load(std::memory_order_relaxed);
+   for (;;) {
+      Slot* slot = SlotAt(pos);
+      uint64_t seq = slot->sequence.load(std::memory_order_acquire);
+      int64_t diff = static_cast<int64_t>(seq - (pos + 1));
+      if (diff == 0) {
+         if (header->dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            return slot;
+         }
+      }
+      else if (diff < 0) {
+         return nullptr; // empty
+      }
+      else {
+         pos = header->dequeuePos.load(std::memory_order_relaxed);
+      }
+   }
+}
+
+void SharedMemoryRing::ReleaseRead(Slot* slot, uint64_t pos) {
+   slot->sequence.store(pos + header->mask + 1, std::memory_order_release);
+   Signal(header->spaceFutex, header->spaceWaiters);
+}
+
+bool SharedMemoryRing::HasItems() const {
+   uint64_t pos = header->dequeuePos.load();
+   return static_cast<int64_t>(SlotAt(pos)->sequence.load() - (pos + 1)) >= 0;
+}
+
+bool SharedMemoryRing::WaitForItems(const std::atomic<bool>& running) {
+   for (int spin = 0; spin < SpinCount; ++spin) {
+      if (HasItems()) {
+         return running.load();
+      }
+      std::this_thread::yield();
+   }
+
+   uint32_t epoch = header->itemsFutex.load();
+   header->itemsWaiters.fetch_add(1);
+   if (!HasItems() && running.load()) {
+      FutexWait(header->itemsFutex, epoch);
+   }
+   header->itemsWaiters.fetch_sub(1);
+   return running.load();
+}
+
+void SharedMemoryRing::WakeAll() {
+   if (!header) {
+      return;
+   }
+   header->itemsFutex.fetch_add(1);
+   FutexWake(header->itemsFutex, INT_MAX);
+   header->spaceFutex.fetch_add(1);
+   FutexWake(header->spaceFutex, INT_MAX);
+}
+#endif
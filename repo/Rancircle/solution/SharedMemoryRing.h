@@ -0,0 +1,144 @@
+#pragma once
+
+#ifndef _WIN32
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <stdexcept>
+
+// Cross-process bounded MPMC ring living in a POSIX shared-memory object (shm_open + mmap).
+// Every process that opens the same name maps the same slots; producers and consumers
+// claim slots with sequence numbers (no kernel involvement on the fast path) and block
+// on futex words stored in the mapping when the ring is empty or full, so a wakeup costs
+// one FUTEX_WAKE and only when somebody is actually sleeping.
+class SharedMemoryRing {
+public:
+   using Clock = std::chrono::steady_clock;
+
+   SharedMemoryRing() = default;
+   ~SharedMemoryRing();
+
+   SharedMemoryRing(const SharedMemoryRing&) = delete;
+   SharedMemoryRing& operator=(const SharedMemoryRing&) = delete;
+
+   // Creates the object or attaches to an existing one with the same geometry.
+   // With attachOnly, fails instead of creating a missing object.
+   bool Open(const std::string& name, uint32_t slotCount, uint32_t slotPayloadSize, bool attachOnly = false);
+   // Unmaps the ring; with unlink the process that created the object also marks it retired
+   // (waking blocked producers) and removes its name
+   void Close(bool unlink);
+   bool IsOpen() const { return header != nullptr; }
+   // True once the creator closed the ring with unlink: nobody will consume from it again
+   bool IsRetired() const;
+
+   // Retires and unlinks an object left under name by a process that exited without
+   // closing it, so that a fresh Open creates a new one
+   static void Retire(const std::string& name, uint32_t slotCount, uint32_t slotPayloadSize);
+
+   uint32_t MaxPayloadSize() const { return payloadSize; }
+
+   // Copies size bytes into the next free slot, blocking while the ring is full.
+   // Returns false if running turned false or deadline passed while waiting, or the ring
+   // was retired; throws std::length_error if size exceeds MaxPayloadSize().
+   bool Push(int32_t tag, const void* data, size_t size, const std::atomic<bool>& running,
+      Clock::time_point deadline = Clock::time_point::max());
+
+   // Same as Push, but lets the caller serialize straight into the slot:
+   // encode(unsigned char* dst) must write exactly size bytes and must not throw.
+   template<typename Encode>
+   bool Emplace(int32_t tag, size_t size, Encode&& encode, const std::atomic<bool>& running,
+      Clock::time_point deadline = Clock::time_point::max());
+
+   // Blocks until a slot is available and calls consume(tag, data, size) on it in place;
+   // the slot is handed back to producers once consume returns.
+   // Returns false without consuming as soon as running turns false; whatever is still
+   // queued stays in the ring for the other attached processes.
+   template<typename Consume>
+   bool Pop(Consume&& consume, const std::atomic<bool>& running);
+
+   // Non-blocking Pop: returns false right away when the ring is empty
+   template<typename Consume>
+   bool TryPop(Consume&& consume);
+
+   // Wakes every process blocked on this ring so it can re-check its running flag
+   void WakeAll();
+
+private:
+   struct Header;
+   struct Slot;
+
+   Slot* SlotAt(uint64_t pos) const;
+   Slot* ClaimWrite(uint64_t& pos, const std::atomic<bool>& running, Clock::time_point deadline);
+   void PublishWrite(Slot* slot, uint64_t pos);
+   Slot* TryClaimRead(uint64_t& pos);
+   void ReleaseRead(Slot* slot, uint64_t pos);
+   bool HasItems() const;
+   bool WaitForItems(const std::atomic<bool>& running);
+
+   Header* header = nullptr;
+   unsigned char* slots = nullptr;
+   size_t mappedSize = 0;
+   size_t slotStride = 0;
+   uint32_t payloadSize = 0;
+   bool owner = false;
+   std::string shmName;
+};
+
+struct SharedMemoryRing::Slot {
+   std::atomic<uint64_t> sequence;
+   int32_t tag;
+   uint32_t size;
+   unsigned char data[1];
+};
+
+template<typename Encode>
+bool SharedMemoryRing::Emplace(int32_t tag, size_t size, Encode&& encode, const std::atomic<bool>& running,
+   Clock::time_point deadline) {
+   if (size > payloadSize) {
+      throw std::length_error("SharedMemoryRing: message exceeds slot payload size");
+   }
+   uint64_t pos = 0;
+   Slot* slot = ClaimWrite(pos, running, deadline);
+   if (!slot) {
+      return false;
+   }
+   slot->tag = tag;
+   slot->size = static_cast<uint32_t>(size);
+   encode(slot->data);
+   PublishWrite(slot, pos);
+   return true;
+}
+
+template<typename Consume>
+bool SharedMemoryRing::Pop(Consume&& consume, const std::atomic<bool>& running) {
+   while (running.load()) {
+      if (TryPop(consume)) {
+         return true;
+      }
+      if (!WaitForItems(running)) {
+         return false;
+      }
+   }
+   return false;
+}
+
+template<typename Consume>
+bool SharedMemoryRing::TryPop(Consume&& consume) {
+   uint64_t pos = 0;
+   Slot* slot = TryClaimRead(pos);
+   if (!slot) {
+      return false;
+   }
+   try {
+      consume(slot->tag, slot->data, static_cast<size_t>(slot->size));
+   }
+   catch (...) {
+      ReleaseRead(slot, pos);
+      throw;
+   }
+   ReleaseRead(slot, pos);
+   return true;
+}
+#endif
@@ -0,0 +1,260 @@
+#include "SharedMemorySlab.h"
+
+#ifndef _WIN32
+#include "SharedMemoryObject.h"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <pthread.h>
+#include <sys/mman.h>
+
+namespace {
+   struct SlabHeader {
+      static constexpr uint32_t ReadyMagic = 0x534C4142; // "SLAB"
+
+      std::atomic<uint32_t> state;
+      uint32_t blockSize;
+      uint32_t blockCount;
+      uint32_t nextHint;
+      pthread_mutex_t mutex; // process-shared, robust; guards the used flags only
+   };
+
+   struct BlockInfo {
+      std::atomic<uint32_t> refs;
+      uint32_t generation;
+      uint32_t runLength; // blocks in the allocation starting here
+      uint32_t used;
+      uint64_t size;
+   };
+
+   uint64_t MakeHandle(uint32_t index, uint32_t generation) {
+      return (static_cast<uint64_t>(generation) << 32) | (static_cast<uint64_t>(index) + 1);
+   }
+}
+
+struct SharedMemorySlab::Mapping : public ISharedBufferPool, public std::enable_shared_from_this<Mapping> {
+   void* base = nullptr;
+   size_t mappedSize = 0;
+   SlabHeader* header = nullptr;
+   BlockInfo* blocks = nullptr;
+   unsigned char* data = nullptr;
+
+   ~Mapping() override {
+      if (base) {
+         munmap(base, mappedSize);
+      }
+   }
+
+   void Lock() {
+      if (pthread_mutex_lock(&header->mutex) == EOWNERDEAD) {
+         // A process died holding the lock; the used flags are still consistent
+         pthread_mutex_consistent(&header->mutex);
+      }
+   }
+
+   void Unlock() {
+      pthread_mutex_unlock(&header->mutex);
+   }
+
+   BlockInfo* Resolve(uint64_t handle) const {
+      uint64_t index = (handle & 0xFFFFFFFFu);
+      if (index == 0 || index > header->blockCount) {
+         return nullptr;
+      }
+      BlockInfo* block = &blocks[index - 1];
+      return block->generation == static_cast<uint32_t>(handle >> 32) ? block : nullptr;
+   }
+
+   unsigned char* DataOf(uint64_t handle) const {
+      return data + static_cast<size_t>((handle & 0xFFFFFFFFu) - 1) * header->blockSize;
+   }
+
+   uint64_t Allocate(size_t size) {
+      size_t needed = size == 0 ? 1 : (size + header->blockSize - 1) / header->blockSize;
+      uint32_t count = header->blockCount;
+      if (needed > count) {
+         return 0;
+      }
+
+      Lock();
+      uint32_t start = header->nextHint < count ? header->nextHint : 0;
+      for (uint32_t scanned = 0; scanned < count; ) {
+         if (start + needed > count) {
+            scanned += count - start;
+            start = 0;
+            continue;
+         }
+         size_t run = 0;
+         while (run < needed && !blocks[start + run].used) {
+            ++run;
+         }
+         if (run == needed) {
+            for (size_t i = 0; i < needed; ++i) {
+               blocks[start + i].used = 1;
+            }
+            BlockInfo& head = blocks[start];
+            head.runLength = static_cast<uint32_t>(needed);
+            head.size = size;
+            head.refs.store(1, std::memory_order_relaxed);
+            header->nextHint = static_cast<uint32_t>(start + needed);
+            uint64_t handle = MakeHandle(start, head.generation);
+            Unlock();
+            return handle;
+         }
+         scanned += static_cast<uint32_t>(run + 1);
+         start += static_cast<uint32_t>(run + 1);
+      }
+      Unlock();
+      return 0;
+   }
+
+   void Release(uint64_t handle) {
+      BlockInfo* head = Resolve(handle);
+      if (!head || head->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+         return;
+      }
+      Lock();
+      for (uint32_t i = 0; i < head->runLength; ++i) {
+         head[i].used = 0;
+      }
+      ++head->generation; // stale handles stop resolving
+      Unlock();
+   }
+
+   void Retain(uint64_t handle) override {
+      if (BlockInfo* head = Resolve(handle)) {
+         head->refs.fetch_add(1, std::memory_order_relaxed);
+      }
+   }
+
+   SharedBuffer Adopt(uint64_t handle, size_t size) override;
+};
+
+// Storage for a SharedBuffer whose bytes live in the slab; dropping it releases one reference
+class SharedMemorySlab::SlabStorage final : public SharedBuffer::Storage {
+public:
+   SlabStorage(std::shared_ptr<Mapping> owner, uint64_t blockHandle, size_t byteCount)
+      : mapping(std::move(owner)), handle(blockHandle), bytes(mapping->DataOf(blockHandle)), size(byteCount) {}
+
+   ~SlabStorage() override {
+      mapping->Release(handle);
+   }
+
+   const unsigned char* Data() const override { return bytes; }
+   size_t Size() const override { return size; }
+   ISharedBufferPool* Pool() const override { return mapping.get(); }
+   uint64_t Handle() const override { return handle; }
+
+private:
+   std::shared_ptr<Mapping> mapping;
+   uint64_t handle;
+   const unsigned char* bytes;
+   size_t size;
+};
+
+SharedBuffer SharedMemorySlab::Mapping::Adopt(uint64_t handle, size_t size) {
+   BlockInfo* head = Resolve(handle);
+   if (!head || size > head->size) {
+      return SharedBuffer();
+   }
+   return SharedBuffer(std::make_shared<SlabStorage>(shared_from_this(), handle, size));
+}
+
+SharedMemorySlab::~SharedMemorySlab() {
+   Close(false);
+}
+
+bool SharedMemorySlab::Open(const std::string& name, uint32_t blockSize, uint32_t blockCount) {
+   if (IsOpen()) {
+      return true;
+   }
+
+   std::string objectName = shm::ObjectName(name);
+   size_t headerSize = shm::AlignUp(sizeof(SlabHeader), shm::CacheLine);
+   size_t infoSize = shm::AlignUp(sizeof(BlockInfo) * blockCount, shm::CacheLine);
+   size_t totalSize = headerSize + infoSize + static_cast<size_t>(blockSize) * blockCount;
+
+   bool creator = false;
+   void* mem = shm::MapObject(objectName, totalSize, creator);
+   if (!mem) {
+      return false;
+   }
+
+   auto map = std::make_shared<Mapping>();
+   map->base = mem;
+   map->mappedSize = totalSize;
+   map->blocks = reinterpret_cast<BlockInfo*>(static_cast<unsigned char*>(mem) + headerSize);
+   map->data = static_cast<unsigned char*>(mem) + headerSize + infoSize;
+
+   if (creator) {
+      map->header = new (mem) SlabHeader();
+      map->header->blockSize = blockSize;
+      map->header->blockCount = blockCount;
+      map->header->nextHint = 0;
+
+      pthread_mutexattr_t attr;
+      pthread_mutexattr_init(&attr);
+      pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+      pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+      pthread_mutex_init(&map->header->mutex, &attr);
+      pthread_mutexattr_destroy(&attr);
+
+      for (uint32_t i = 0; i < blockCount; ++i) {
+         new (&map->blocks[i]) BlockInfo();
+      }
+      map->header->state.store(SlabHeader::ReadyMagic, std::memory_order_release);
+   }
+   else {
+      map->header = static_cast<SlabHeader*>(mem);
+      if (!shm::WaitReady(map->header->state, SlabHeader::ReadyMagic)
+         || map->header->blockSize != blockSize || map->header->blockCount != blockCount) {
+         return false; // map's destructor unmaps
+      }
+   }
+
+   owner = creator;
+   objectName.swap(shmName);
+   mapping = std::move(map);
+   return true;
+}
+
+void SharedMemorySlab::Close(bool unlink) {
+   if (mapping) {
+      mapping.reset();
+      if (unlink && owner) {
+         shm_unlink(shmName.c_str());
+      }
+      owner = false;
+   }
+}
+
+uint64_t SharedMemorySlab::Allocate(size_t size) {
+   return mapping ? mapping->Allocate(size) : 0;
+}
+
+unsigned char* SharedMemorySlab::Data(uint64_t handle) const {
+   return mapping && mapping->Resolve(handle) ? mapping->DataOf(handle) : nullptr;
+}
+
+void SharedMemorySlab::Release(uint64_t handle) {
+   if (mapping) {
+      mapping->Release(handle);
+   }
+}
+
+SharedBuffer SharedMemorySlab::Create(const void* data, size_t size) {
+   uint64_t handle = Allocate(size);
+   if (handle == 0) {
+      return SharedBuffer();
+   }
+   if (size > 0) {
+      memcpy(mapping->DataOf(handle), data, size);
+   }
+   return SharedBuffer(std::make_shared<SlabStorage>(mapping, handle, size));
+}
+
+ISharedBufferPool* SharedMemorySlab::Pool() const {
+   return mapping.get();
+}
+#endif
@@ -0,0 +1,51 @@
+#pragma once
+
+#ifndef _WIN32
+#include "SharedBuffer.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Cross-process pool for payloads too large to travel inline through a SharedMemoryRing.
+// The slab is a POSIX shared-memory object split into fixed-size blocks; an allocation takes
+// a run of contiguous blocks and is identified by a 64-bit handle (block index + generation)
+// that any attached process can resolve to the same bytes. Each allocation carries an atomic
+// reference count in shared memory: the producer's SharedBuffer and every message in flight
+// hold one reference each, and the blocks return to the pool when the last one is dropped,
+// whichever process that happens in.
+class SharedMemorySlab {
+public:
+   SharedMemorySlab() = default;
+   ~SharedMemorySlab();
+
+   SharedMemorySlab(const SharedMemorySlab&) = delete;
+   SharedMemorySlab& operator=(const SharedMemorySlab&) = delete;
+
+   bool Open(const std::string& name, uint32_t blockSize, uint32_t blockCount);
+   // Detaches; buffers still referencing the slab keep the mapping alive until released
+   void Close(bool unlink);
+   bool IsOpen() const { return mapping != nullptr; }
+
+   // Allocates size bytes holding one reference for the caller. Returns 0 when the slab
+   // has no run of free blocks large enough.
+   uint64_t Allocate(size_t size);
+   unsigned char* Data(uint64_t handle) const;
+   void Release(uint64_t handle);
+
+   // Copies data into a new allocation and returns a buffer owning its reference.
+   // Returns an empty buffer when the slab is exhausted.
+   SharedBuffer Create(const void* data, size_t size);
+
+   // Pool interface handed to ParameterCodec; identifies buffers that live in this slab
+   ISharedBufferPool* Pool() const;
+
+private:
+   struct Mapping;
+   class SlabStorage;
+
+   std::shared_ptr<Mapping> mapping;
+   bool owner = false;
+   std::string shmName;
+};
+#endif
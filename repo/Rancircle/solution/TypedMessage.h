@@ -0,0 +1,55 @@
+#pragma once
+#include "messageQueue.h"
+#include <functional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// Compile-time typed message: a message id bound to a fixed list of argument types.
+// Send() checks the arguments against the definition at compile time and queues them as
+// a std::tuple<Args...> payload; in-process queues hand that tuple to the handler as-is
+// (no variant boxing or visiting), and the IPC queue writes it with the fixed layout
+// generated by PayloadLayout. Any number of arguments is supported.
+//
+//   DEFINE_MESSAGE(MSG_UPDATE, int, std::string);
+//   MSG_UPDATE_Message::Handle(queue, [](const int& code, const std::string& text) { ... });
+//   MSG_UPDATE_Message::Send(queue, 42, "Hello");
+template<IMessageQueue::MessageId Id, typename... Args>
+class TypedMessage {
+public:
+   static constexpr IMessageQueue::MessageId id = Id;
+   using Arguments = std::tuple<Args...>;
+   using Handler = std::function<void(const Args&...)>;
+
+   template<typename... Values>
+   static void Send(IMessageQueue& queue, Values&&... values) {
+      static_assert(Accepts<Values...>(), "Arguments do not match the message definition");
+      queue.QueuePayload(Id, MessagePayload::Make<Arguments>(std::forward<Values>(values)...));
+   }
+
+   static void Handle(IMessageQueue& queue, Handler handler) {
+      IMessageQueue::PayloadHandler entry;
+      entry.handle = [handler = std::move(handler)](const MessagePayload& payload) {
+         // A payload of another definition with the same id is ignored
+         if (const Arguments* arguments = payload.Get<Arguments>()) {
+            std::apply(handler, *arguments);
+         }
+      };
+      entry.decode = &MessagePayload::Decode<Arguments>;
+      queue.RegisterPayloadHandler(Id, std::move(entry));
+   }
+
+private:
+   template<typename... Values>
+   static constexpr bool Accepts() {
+      if constexpr (sizeof...(Values) != sizeof...(Args)) {
+         return false;
+      }
+      else {
+         return (std::is_constructible_v<Args, Values&&> && ...);
+      }
+   }
+};
+
+// Declares <id>_Message as the typed message for id with the listed argument types
+#define DEFINE_MESSAGE(id, ...) using id##_Message = TypedMessage<id, ##__VA_ARGS__>
\ No newline at end of file
@@ -12,6 +12,10 @@
 #include <cstddef> // For size_t
 #include <iostream> // For sample output
 #include <string>
+#include <atomic>
+#include <mutex>
+#include "callbackRegistry.hpp"
+#include "rcuDomain.hpp"
 
 namespace detail {
    // Base function_traits template
@@ -113,7 +117,10 @@ public:
    }
 
    // Private constructor for singleton
-   CallbackManager() = default;
+   // Ids in [0, denseIdLimit) are looked up by direct index; pass 0 to hash every id
+   explicit CallbackManager(size_t denseIdLimit = CallbackTable::DefaultDenseLimit)
+      : m_tableOwner(std::make_shared<const CallbackTable>(denseIdLimit)),
+        m_table(m_tableOwner.get()) {}
 
    // Derived class to hold the specific function and handle type-safe invocation internally
    // Specialized with the actual return type (R) and argument types (Args...) of the stored function
@@ -171,10 +178,10 @@ public:
       constexpr size_t Arity = traits::arity;       // Number of arguments
 
       // Use the helper to unpack the argument types from the tuple and create the specific Callback instance
-      m_callbacks[id] = unpack_and_create<R, F, ArgsTuple>(
+      publish(id, unpack_and_create<R, F, ArgsTuple>(
          std::forward<F>(f),              // The function/callable to register
          std::make_index_sequence<Arity>{} // Generate sequence 0, 1, ..., Arity-1
-      );
+      ));
    }
 
    // Registration for member function pointers (non-const)
@@ -210,10 +217,13 @@ public:
    // Caller must specify the expected return type R
    // and provide arguments (Args&&... args) that are compatible with the registered callback's
    // parameters for std::any_cast.
+   // Safe to call concurrently with registration from any thread. The lookup is wait-free, and
+   // a callback replaced while this call is running stays alive until the call returns.
    template<typename R, typename... Args>
    R invoke(CallbackId id, Args&&... args) {
-      auto it = m_callbacks.find(id);
-      if (it == m_callbacks.end()) {
+      RcuDomain::ReadGuard guard;
+      ICallbackBase* callback = m_table.load(std::memory_order_acquire)->get(id);
+      if (!callback) {
          // Use a more informative error message
          throw std::runtime_error("Callback not found for id: " + std::to_string(id));
       }
@@ -226,7 +236,7 @@ public:
       // Call the type-erased invoke method on the stored callback object
       // This call handles the unpacking and casting of anyArgs to the function's
       // original arguments and calls the stored function.
-      std::any result_any = it->second->invoke(anyArgs);
+      std::any result_any = callback->invoke(anyArgs);
 
       // Try to cast the result (which is in a std::any) back to the caller's expected return type R
       // This is where a mismatch in return type between the registered function and
@@ -257,9 +267,38 @@ public:
       invoke<void, Args...>(id, std::forward<Args>(args)...);
    }
 
+   // Removes the callback; a call already running on it completes normally
+   void removeCallback(CallbackId id) {
+      publish(id, nullptr);
+   }
+
 private:
-   // The map storing the registered callbacks, type-erased via ICallbackBase
-   std::unordered_map<CallbackId, std::shared_ptr<ICallbackBase>> m_callbacks;
+   using CallbackTable = DenseIdTable<std::shared_ptr<ICallbackBase>>;
+
+   // Copy-on-write update: readers keep using the snapshot they loaded, and the previous
+   // snapshot (with any callback it alone still owns) is retired to the RCU domain.
+   void publish(CallbackId id, std::shared_ptr<ICallbackBase> callback) {
+      std::shared_ptr<const CallbackTable> previous;
+      {
+         std::lock_guard<std::mutex> lock(m_writeMutex);
+         auto next = std::make_shared<CallbackTable>(*m_tableOwner);
+         if (callback) {
+            next->slot(id) = std::move(callback);
+         }
+         else {
+            next->erase(id);
+         }
+         previous = std::exchange(m_tableOwner, std::shared_ptr<const CallbackTable>(std::move(next)));
+         m_table.store(m_tableOwner.get(), std::memory_order_seq_cst);
+      }
+      RcuDomain::instance().retire(std::move(previous));
+   }
+
+   // The table storing the registered callbacks, type-erased via ICallbackBase.
+   // m_table is the published snapshot read by invoke; m_tableOwner owns it (writers only).
+   std::mutex m_writeMutex;
+   std::shared_ptr<const CallbackTable> m_tableOwner;
+   std::atomic<const CallbackTable*> m_table;
 
    // Disable copy and assignment for singleton
    CallbackManager(const CallbackManager&) = delete;
@@ -4,13 +4,17 @@
 #include <functional>
 #include <unordered_map>
 #include <vector>
-#include <shared_mutex>
 #include <string>
 #include <cstdint>
 #include <stdexcept>
 #include <iostream>
 #include <any>
-#include <thread>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include "threadPoolExecutor.hpp"
+#include "nodePool.hpp"
+#include "Metrics.h"
 
 /// ̺Ʈ Ű Ÿ
 using EventKey = unsigned int;
@@ -38,48 +42,135 @@ public:
 };
 
 /// std::function  ó (Ƽ ݹ )
-/// ݹ  忡 񵿱 Ͽ  
+/// ݹ IExecutor(⺻:  ThreadPoolExecutor) Ͽ 񵿱 
 class EventCallbackDispatcher : public IEventCallback {
 public:
    using CallbackMsg = std::function<void(const Message&)>;
 
+   /// executor   μ   Ǯ  (ó  Ƿ shutdownص  )
+   explicit EventCallbackDispatcher(std::shared_ptr<IExecutor> executor = nullptr)
+      : table_(std::make_shared<const CallbackTable>()),
+        executor_(executor ? std::move(executor) : ThreadPoolExecutor::shared()),
+        ownsExecutor_(false),
+        inFlight_(std::make_shared<InFlight>()),
+        metrics_(std::make_shared<MetricsRegistry>()) {}
+
+   /// workerCount   Ǯ   (shutdown  Բ )
+   explicit EventCallbackDispatcher(size_t workerCount)
+      : table_(std::make_shared<const CallbackTable>()),
+        executor_(std::make_shared<ThreadPoolExecutor>(workerCount)),
+        ownsExecutor_(true),
+        inFlight_(std::make_shared<InFlight>()),
+        metrics_(std::make_shared<MetricsRegistry>()) {}
+
    /// Ư ̺Ʈ ޽  ݹ 
+   ///     ü (ش ̺Ʈ Ʈ 籸)
    void registerCallback(const EventKey& event, CallbackMsg cb) {
-      std::unique_lock lock(mutex_);
-      callbacks_[event].push_back(std::move(cb));
+      std::lock_guard<std::mutex> lock(writeMutex_);
+      auto next = std::make_shared<CallbackTable>(*std::atomic_load(&table_));
+      auto list = std::make_shared<CallbackList>();
+      auto it = next->find(event);
+      if (it != next->end()) {
+         *list = *it->second;
+      }
+      list->push_back(std::move(cb));
+      (*next)[event] = std::move(list);
+      std::atomic_store(&table_, std::shared_ptr<const CallbackTable>(std::move(next)));
    }
 
    /// Ư ̺Ʈ  ݹ 
    void unregisterCallbacks(const EventKey& event) {
-      std::unique_lock lock(mutex_);
-      callbacks_.erase(event);
+      std::lock_guard<std::mutex> lock(writeMutex_);
+      auto current = std::atomic_load(&table_);
+      if (current->find(event) == current->end()) {
+         return;
+      }
+      auto next = std::make_shared<CallbackTable>(*current);
+      next->erase(event);
+      std::atomic_store(&table_, std::shared_ptr<const CallbackTable>(std::move(next)));
    }
 
-   /// ̺Ʈ ߻: ޽ Ͽ ϵ ݹ  忡 
+   /// ̺Ʈ ߻: ϵ ݹ executor ۾ 
+   ///     , ݹ Ʈ  īƮ  ( )
    void onEvent(const Message& msg) const override {
-      std::vector<CallbackMsg> cbs;
-      {
-         std::shared_lock lock(mutex_);
-         auto it = callbacks_.find(msg.event);
-         if (it == callbacks_.end() || it->second.empty()) {
-            throw HandlerNotFoundException(msg.event);
+      auto table = std::atomic_load(&table_);
+      auto it = table->find(msg.event);
+      const bool recording = metrics_->Enabled();
+      if (it == table->end() || it->second->empty()) {
+         if (recording) {
+            metrics_->Dropped(msg.event);
          }
-         // ݹ Ʈ 
-         cbs = it->second;
+         throw HandlerNotFoundException(msg.event);
       }
-      //  ݹ   忡 
-      for (const auto& cb : cbs) {
-         std::thread([cb, msg]() mutable {
-            try {
-               cb(msg);
-            }
-            catch (const std::exception& e) {
-               std::cerr << "Callback exception: " << e.what() << std::endl;
-            }
-            catch (...) {
-               std::cerr << "Callback unknown exception" << std::endl;
+      const std::shared_ptr<const CallbackList>& cbs = it->second;
+      const size_t count = cbs->size();
+
+      // 带     θ ȮϹǷ, shutdown 0  ڿ Ǵ  
+      inFlight_->nodes.fetch_add(1);
+      if (!inFlight_->accepting.load()) {
+         inFlight_->finish();
+         if (recording) {
+            metrics_->Dropped(msg.event, count);
+         }
+         throw std::runtime_error("Dispatcher is shut down");
+      }
+
+      // Ʈ    Ʈ   ð 忡  (  ߰  )
+      std::shared_ptr<MetricsRegistry> metrics;
+      MetricsRegistry::Clock::time_point postedAt;
+      if (recording) {
+         metrics = metrics_;
+         postedAt = MetricsRegistry::Clock::now();
+         metrics->Enqueued(msg.event, count);
+      }
+
+      // ޽ Ǯ  忡   Ͽ  ݹ ۾ 
+      // ۾  Ϳ ε ĸóϹǷ std::function  ۿ   Ҵ 
+      EventNode* node = NodePool<EventNode>::instance().create(msg, cbs, count, inFlight_, std::move(metrics), postedAt);
+      for (size_t i = 0; i < count; ++i) {
+         bool posted = executor_->post([node, i]() {
+            runCallback(node, i);
+            releaseNode(node, 1);
+            });
+         if (!posted) {
+            if (node->metrics) {
+               node->metrics->Dropped(msg.event, count - i);
             }
-            }).detach();
+            releaseNode(node, count - i);
+            throw std::runtime_error("Dispatcher executor is shut down");
+         }
+      }
+   }
+
+   /// Ʈ  ѱ/ (⺻ ). ̺Ʈ Ű  ݹ ۾ ,   ,
+   /// ڵ鷯 / (dropped), ݹ  , ~  ð ݹ  ð 
+   void enableMetrics(bool enabled) const {
+      metrics_->Enable(enabled);
+   }
+
+   ///  Ʈ  (MessageMetrics::id EventKey)
+   MetricsSnapshot metrics() const {
+      return metrics_->Snapshot();
+   }
+
+   /// ̺Ʈ  Ǯ ī ( ó ϴ Ǯ)
+   static PoolStats eventPoolStats() {
+      return NodePool<EventNode>::instance().stats();
+   }
+
+   ///  ó   ݹ    ( executor ٸ ۾ ٸ )
+   ///  ó ݹ ȿ ȣϸ 
+   void drain() const {
+      std::unique_lock<std::mutex> lock(inFlight_->mutex);
+      inFlight_->idle.wait(lock, [this] { return inFlight_->nodes.load() == 0; });
+   }
+
+   ///  ̺Ʈ  ߴ   ó ݹ Ϸ . executor ó  쿡 
+   void shutdown() const {
+      inFlight_->accepting.store(false);
+      drain();
+      if (ownsExecutor_) {
+         executor_->shutdown();
       }
    }
 
@@ -108,8 +199,87 @@ public:
    }
 
 private:
-   mutable std::shared_mutex                             mutex_;
-   std::unordered_map<EventKey, std::vector<CallbackMsg>> callbacks_;
+   using CallbackList  = std::vector<CallbackMsg>;
+   using CallbackTable = std::unordered_map<EventKey, std::shared_ptr<const CallbackList>>;
+
+   /// ó ̿Ϸ EventNode . drain/shutdown  executor ü ƴ   ٸ
+   struct InFlight {
+      std::atomic<size_t>     nodes{ 0 };
+      std::atomic<bool>       accepting{ true };
+      std::mutex              mutex;
+      std::condition_variable idle;
+
+      void finish() {
+         if (nodes.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(mutex);
+            idle.notify_all();
+         }
+      }
+   };
+
+   /// onEvent   ޽ ݹ Ʈ.  ݹ ۾  Ǯ ȯ
+   struct EventNode {
+      EventNode(const Message& message, std::shared_ptr<const CallbackList> list, size_t count,
+         std::shared_ptr<InFlight> tracker,
+         std::shared_ptr<MetricsRegistry> registry, MetricsRegistry::Clock::time_point posted)
+         : msg(message), callbacks(std::move(list)), remaining(count), inFlight(std::move(tracker)),
+           metrics(std::move(registry)), postedAt(posted) {}
+
+      Message                             msg;
+      std::shared_ptr<const CallbackList> callbacks;
+      std::atomic<size_t>                 remaining;
+      std::shared_ptr<InFlight>           inFlight;
+      std::shared_ptr<MetricsRegistry>    metrics;  ///<   ƴϸ nullptr
+      MetricsRegistry::Clock::time_point  postedAt;
+   };
+
+   /// ݹ ϳ . ܴ ۾   ʰ α  Ʈ 
+   static void runCallback(EventNode* node, size_t i) {
+      MetricsRegistry* metrics = node->metrics.get();
+      MetricsRegistry::Clock::time_point start;
+      if (metrics) {
+         start = MetricsRegistry::Clock::now();
+         metrics->Dispatched(node->msg.event, node->postedAt, start);
+      }
+      bool failed = false;
+      try {
+         (*node->callbacks)[i](node->msg);
+      }
+      catch (const std::exception& e) {
+         failed = true;
+         std::cerr << "Callback exception: " << e.what() << std::endl;
+      }
+      catch (...) {
+         failed = true;
+         std::cerr << "Callback unknown exception" << std::endl;
+      }
+      if (metrics) {
+         metrics->HandlerRan(node->msg.event, MetricsRegistry::Clock::now() - start);
+         if (failed) {
+            metrics->HandlerFailed(node->msg.event);
+         }
+      }
+   }
+
+   /// ۾ count   (  ۾  )
+   static void releaseNode(EventNode* node, size_t count) {
+      if (node->remaining.fetch_sub(count, std::memory_order_acq_rel) == count) {
+         // 带 Ǯ  ڿ ϷḦ ˷ drain  尡   
+         std::shared_ptr<InFlight> inFlight = std::move(node->inFlight);
+         NodePool<EventNode>::instance().destroy(node);
+         inFlight->finish();
+      }
+   }
+
+   /// Һ : б std::atomic_load,  writeMutex_ Ͽ   std::atomic_store
+   std::shared_ptr<const CallbackTable>                  table_;
+   std::mutex                                            writeMutex_;
+   std::shared_ptr<IExecutor>                            executor_;
+   const bool                                            ownsExecutor_;
+   /// 尡 ó    Ƿ  
+   std::shared_ptr<InFlight>                             inFlight_;
+   ///   ۾ ó    Ƿ  
+   std::shared_ptr<MetricsRegistry>                      metrics_;
 };
 
 #endif
\ No newline at end of file
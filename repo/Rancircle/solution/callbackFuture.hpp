@@ -0,0 +1,377 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "threadPoolExecutor.hpp"
+
+// C++20 coroutine support (co_await on a CallbackFuture, coroutines returning one) is
+// compiled only when the compiler provides it; the C++17 API is unaffected.
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define CALLBACK_FUTURE_COROUTINES 1
+#endif
+
+template<typename T> class CallbackFuture;
+template<typename T> class CallbackPromise;
+template<typename T> class CallbackFutureAwaiter;
+template<typename T> class CallbackCoroutinePromise;
+
+// Placeholder value stored by futures of void
+struct VoidResult {};
+
+// Shared state between a CallbackPromise and its CallbackFuture.
+// States are intrusively reference counted and recycled through a per-thread free list
+// (spilling to a global list), so an asynchronous call does not allocate its shared state.
+template<typename T>
+class FutureState {
+public:
+   using Value = std::conditional_t<std::is_void_v<T>, VoidResult, T>;
+
+   static FutureState* create(std::shared_ptr<IExecutor> executor) {
+      FutureState* state = acquire();
+      state->m_refs.store(1, std::memory_order_relaxed);
+      state->m_executor = std::move(executor);
+      return state;
+   }
+
+   void addRef() { m_refs.fetch_add(1, std::memory_order_relaxed); }
+
+   void release() {
+      if (m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+         m_value.reset();
+         m_error = nullptr;
+         m_continuation = nullptr;
+         m_executor.reset();
+         m_ready.store(false, std::memory_order_relaxed);
+         recycle(this);
+      }
+   }
+
+   // The first result wins; later ones are ignored
+   template<typename... V>
+   void setValue(V&&... value) {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (m_ready.load(std::memory_order_relaxed)) {
+         return;
+      }
+      m_value.emplace(std::forward<V>(value)...);
+      complete(lock);
+   }
+
+   void setException(std::exception_ptr error) {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (m_ready.load(std::memory_order_relaxed)) {
+         return;
+      }
+      m_error = std::move(error);
+      complete(lock);
+   }
+
+   bool isReady() const { return m_ready.load(std::memory_order_acquire); }
+
+   void wait() {
+      if (isReady()) {
+         return;
+      }
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_readyCv.wait(lock, [this] { return m_ready.load(std::memory_order_relaxed); });
+   }
+
+   // Waits, then moves the value out or rethrows the stored exception
+   Value takeValue() {
+      wait();
+      if (m_error) {
+         std::rethrow_exception(m_error);
+      }
+      return std::move(*m_value);
+   }
+
+   // Runs continuation on the completing thread, or posts it to the executor when the
+   // result is already available (so then() never runs user code on the caller's thread)
+   void onReady(std::function<void()> continuation) {
+      {
+         std::lock_guard<std::mutex> lock(m_mutex);
+         if (!m_ready.load(std::memory_order_relaxed)) {
+            m_continuation = std::move(continuation);
+            return;
+         }
+      }
+      if (!m_executor->post(continuation)) {
+         continuation(); // executor shut down: run inline rather than lose the continuation
+      }
+   }
+
+   const std::shared_ptr<IExecutor>& executor() const { return m_executor; }
+
+private:
+   static constexpr size_t LocalCacheLimit = 64;
+
+   // Per-thread free list; returns its states to the global list when the thread exits
+   struct LocalCache {
+      std::vector<FutureState*> states;
+      ~LocalCache() {
+         GlobalCache& global = globalCache();
+         std::lock_guard<std::mutex> lock(global.mutex);
+         global.states.insert(global.states.end(), states.begin(), states.end());
+      }
+   };
+
+   struct GlobalCache {
+      std::mutex mutex;
+      std::vector<FutureState*> states;
+   };
+
+   // Intentionally leaked: thread caches may flush into it during static destruction
+   static GlobalCache& globalCache() {
+      static GlobalCache* cache = new GlobalCache();
+      return *cache;
+   }
+
+   static LocalCache& localCache() {
+      thread_local LocalCache cache;
+      return cache;
+   }
+
+   static FutureState* acquire() {
+      LocalCache& local = localCache();
+      if (local.states.empty()) {
+         // Producers and consumers are often different threads: refill in batches
+         GlobalCache& global = globalCache();
+         std::lock_guard<std::mutex> lock(global.mutex);
+         size_t take = std::min(global.states.size(), LocalCacheLimit / 2);
+         local.states.assign(global.states.end() - take, global.states.end());
+         global.states.resize(global.states.size() - take);
+      }
+      if (local.states.empty()) {
+         return new FutureState();
+      }
+      FutureState* state = local.states.back();
+      local.states.pop_back();
+      return state;
+   }
+
+   static void recycle(FutureState* state) {
+      LocalCache& local = localCache();
+      local.states.push_back(state);
+      if (local.states.size() > LocalCacheLimit) {
+         GlobalCache& global = globalCache();
+         std::lock_guard<std::mutex> lock(global.mutex);
+         global.states.insert(global.states.end(), local.states.begin() + LocalCacheLimit / 2, local.states.end());
+         local.states.resize(LocalCacheLimit / 2);
+      }
+   }
+
+   void complete(std::unique_lock<std::mutex>& lock) {
+      m_ready.store(true, std::memory_order_release);
+      std::function<void()> continuation = std::move(m_continuation);
+      m_continuation = nullptr;
+      lock.unlock();
+      m_readyCv.notify_all();
+      if (continuation) {
+         continuation();
+      }
+   }
+
+   std::atomic<uint32_t> m_refs{ 0 };
+   std::atomic<bool> m_ready{ false };
+   std::mutex m_mutex;
+   std::condition_variable m_readyCv;
+   std::optional<Value> m_value;
+   std::exception_ptr m_error;
+   std::function<void()> m_continuation;
+   std::shared_ptr<IExecutor> m_executor;
+};
+
+// Intrusive handle to a FutureState
+template<typename T>
+class FutureStatePtr {
+public:
+   FutureStatePtr() = default;
+   explicit FutureStatePtr(FutureState<T>* state) : m_state(state) {}
+   FutureStatePtr(const FutureStatePtr& other) : m_state(other.m_state) {
+      if (m_state) m_state->addRef();
+   }
+   FutureStatePtr(FutureStatePtr&& other) noexcept : m_state(std::exchange(other.m_state, nullptr)) {}
+   FutureStatePtr& operator=(FutureStatePtr other) noexcept {
+      std::swap(m_state, other.m_state);
+      return *this;
+   }
+   ~FutureStatePtr() {
+      if (m_state) m_state->release();
+   }
+
+   FutureState<T>* get() const { return m_state; }
+   FutureState<T>* operator->() const { return m_state; }
+   explicit operator bool() const { return m_state != nullptr; }
+
+private:
+   FutureState<T>* m_state = nullptr;
+};
+
+// Producer side of a CallbackFuture. Copyable so it can travel inside executor tasks.
+template<typename T>
+class CallbackPromise {
+public:
+   explicit CallbackPromise(std::shared_ptr<IExecutor> executor)
+      : m_state(FutureState<T>::create(std::move(executor))) {}
+
+   CallbackFuture<T> getFuture() const { return CallbackFuture<T>(m_state); }
+
+   template<typename... V>
+   void setValue(V&&... value) { m_state->setValue(std::forward<V>(value)...); }
+
+   void setException(std::exception_ptr error) { m_state->setException(std::move(error)); }
+
+   // Stores the result of fn(args...), or the exception it throws
+   template<typename F, typename... FnArgs>
+   void setWith(F& fn, FnArgs&&... args) {
+      try {
+         if constexpr (std::is_void_v<T>) {
+            fn(std::forward<FnArgs>(args)...);
+            setValue();
+         }
+         else {
+            setValue(fn(std::forward<FnArgs>(args)...));
+         }
+      }
+      catch (...) {
+         setException(std::current_exception());
+      }
+   }
+
+private:
+   FutureStatePtr<T> m_state;
+};
+
+// Lightweight, move-only future for asynchronous callback invocations.
+// get() waits and moves the result out (rethrowing a stored exception); then() chains a
+// continuation that runs on the executor without blocking the calling thread.
+template<typename T>
+class CallbackFuture {
+public:
+#ifdef CALLBACK_FUTURE_COROUTINES
+   // A coroutine declared to return CallbackFuture<T> starts eagerly and completes the future
+   using promise_type = CallbackCoroutinePromise<T>;
+#endif
+
+   CallbackFuture() = default;
+   CallbackFuture(CallbackFuture&&) noexcept = default;
+   CallbackFuture& operator=(CallbackFuture&&) noexcept = default;
+   CallbackFuture(const CallbackFuture&) = delete;
+   CallbackFuture& operator=(const CallbackFuture&) = delete;
+
+   bool valid() const { return static_cast<bool>(m_state); }
+   bool isReady() const { return m_state->isReady(); }
+   void wait() const { m_state->wait(); }
+
+   // Invalidates the future
+   T get() {
+      FutureStatePtr<T> state = std::move(m_state);
+      if constexpr (std::is_void_v<T>) {
+         state->takeValue();
+      }
+      else {
+         return state->takeValue();
+      }
+   }
+
+   // Schedules fn(value) (fn() for a void future) once this future is ready and returns a future
+   // for its result. An exception is forwarded to the returned future without calling fn.
+   // fn must be copy-constructible. Invalidates this future.
+   template<typename F>
+   auto then(F&& fn) {
+      using Fn = std::decay_t<F>;
+      using U = typename std::conditional_t<std::is_void_v<T>, std::invoke_result<Fn&>, std::invoke_result<Fn&, T>>::type;
+
+      FutureStatePtr<T> source = std::move(m_state);
+      CallbackPromise<U> promise(source->executor());
+      CallbackFuture<U> result = promise.getFuture();
+
+      FutureState<T>* raw = source.get();
+      raw->onReady([source, promise, fn = Fn(std::forward<F>(fn))]() mutable {
+         try {
+            if constexpr (std::is_void_v<T>) {
+               source->takeValue();
+               promise.setWith(fn);
+            }
+            else {
+               promise.setWith(fn, source->takeValue());
+            }
+         }
+         catch (...) {
+            promise.setException(std::current_exception());
+         }
+      });
+      return result;
+   }
+
+private:
+   friend class CallbackPromise<T>;
+   friend class CallbackFutureAwaiter<T>;
+
+   explicit CallbackFuture(FutureStatePtr<T> state) : m_state(std::move(state)) {}
+
+   FutureStatePtr<T> m_state;
+};
+
+#ifdef CALLBACK_FUTURE_COROUTINES
+// co_await support: the awaiting coroutine is suspended without blocking its thread and is
+// resumed by whichever thread completes the future (an executor or queue worker).
+template<typename T>
+class CallbackFutureAwaiter {
+public:
+   explicit CallbackFutureAwaiter(CallbackFuture<T>&& future) : m_future(std::move(future)) {}
+
+   bool await_ready() const { return m_future.isReady(); }
+
+   void await_suspend(std::coroutine_handle<> handle) {
+      m_future.m_state->onReady([handle] { handle.resume(); });
+   }
+
+   T await_resume() { return m_future.get(); }
+
+private:
+   CallbackFuture<T> m_future;
+};
+
+template<typename T>
+CallbackFutureAwaiter<T> operator co_await(CallbackFuture<T>&& future) {
+   return CallbackFutureAwaiter<T>(std::move(future));
+}
+
+// Coroutine promise for coroutines returning CallbackFuture<T>. The frame runs until its
+// first suspension on the calling thread and destroys itself when the body finishes.
+template<typename T>
+class CallbackCoroutinePromiseBase {
+public:
+   CallbackFuture<T> get_return_object() { return m_promise.getFuture(); }
+   std::suspend_never initial_suspend() noexcept { return {}; }
+   std::suspend_never final_suspend() noexcept { return {}; }
+   void unhandled_exception() { m_promise.setException(std::current_exception()); }
+
+protected:
+   CallbackPromise<T> m_promise{ ThreadPoolExecutor::shared() };
+};
+
+template<typename T>
+class CallbackCoroutinePromise : public CallbackCoroutinePromiseBase<T> {
+public:
+   template<typename V>
+   void return_value(V&& value) { this->m_promise.setValue(std::forward<V>(value)); }
+};
+
+template<>
+class CallbackCoroutinePromise<void> : public CallbackCoroutinePromiseBase<void> {
+public:
+   void return_void() { m_promise.setValue(); }
+};
+#endif
\ No newline at end of file
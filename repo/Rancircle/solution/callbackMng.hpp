@@ -1,26 +1,159 @@
 #pragma once
 #include <iostream>
 #include <functional>
-#include <map>
 #include <memory>
 #include <string>
 #include <any>
+#include <optional>
+#include <string_view>
 #include <tuple>
 #include <typeindex>
 #include <vector>
 #include <type_traits> // Required for std::decay_t, std::is_same_v, etc.
+#include "callbackFuture.hpp"
+#include "callbackRegistry.hpp"
+
+// Unique per-signature key: the address of a static member, compared as a pointer.
+// Cheaper than comparing std::type_info (which may compare mangled names).
+template<typename Sig>
+struct SignatureKey {
+   static constexpr char id = 0;
+};
+
+template<typename Sig>
+inline const void* signatureOf() {
+   return &SignatureKey<Sig>::id;
+}
 
 class CallbackBase {
 public:
    virtual ~CallbackBase() = default;
    virtual void invokeVoid(const std::vector<std::any>& params) const = 0;
    virtual std::any invoke(const std::vector<std::any>& params) const = 0;
+   // signatureOf<Ret(Args...)>() of the stored function, used by the typed fast path
+   virtual const void* signature() const = 0;
+};
+
+// Typed handle to a registered callback: calls the stored std::function directly with
+// perfect forwarding - no std::any boxing, no allocation, no exceptions.
+// Valid until the callback is removed or replaced, like an iterator.
+template<typename Sig>
+class CallbackHandle;
+
+template<typename Ret, typename... Args>
+class CallbackHandle<Ret(Args...)> {
+public:
+   CallbackHandle() = default;
+   explicit CallbackHandle(const std::function<Ret(Args...)>* func) : m_func(func) {}
+
+   template<typename... CallArgs>
+   Ret operator()(CallArgs&&... args) const {
+      return (*m_func)(std::forward<CallArgs>(args)...);
+   }
+
+   explicit operator bool() const { return m_func != nullptr; }
+
+private:
+   const std::function<Ret(Args...)>* m_func = nullptr;
+};
+
+// Coercions from the type held by a std::any argument to a callback parameter type.
+// One table per parameter type, keyed by the std::type_index of the incoming argument:
+// every arithmetic type for an arithmetic parameter (static_cast semantics, so all
+// widenings plus the int/double narrowings that were always accepted), and C strings or
+// string_view for std::string. Lookup is a short scan; no exception is ever thrown.
+template<typename Raw>
+class ArgumentConversions {
+public:
+   using Convert = Raw(*)(const std::any&);
+
+   struct Entry {
+      std::type_index source;
+      Convert convert;
+   };
+
+   static const std::vector<Entry>& table() {
+      static const std::vector<Entry> entries = build();
+      return entries;
+   }
+
+   static Convert find(const std::type_info& source) {
+      for (const Entry& entry : table()) {
+         if (entry.source == source) {
+            return entry.convert;
+         }
+      }
+      return nullptr;
+   }
+
+private:
+   template<typename Source>
+   static Raw convertFrom(const std::any& a) {
+      return static_cast<Raw>(*std::any_cast<Source>(&a));
+   }
+
+   template<typename... Sources>
+   static void add(std::vector<Entry>& entries) {
+      (entries.push_back(Entry{ std::type_index(typeid(Sources)), &convertFrom<Sources> }), ...);
+   }
+
+   static std::vector<Entry> build() {
+      std::vector<Entry> entries;
+      if constexpr (std::is_arithmetic_v<Raw>) {
+         add<bool, char, signed char, unsigned char, wchar_t, char16_t, char32_t,
+            short, unsigned short, int, unsigned int, long, unsigned long,
+            long long, unsigned long long, float, double, long double>(entries);
+      }
+      else if constexpr (std::is_same_v<Raw, std::string>) {
+         add<const char*, char*, std::string_view>(entries);
+      }
+      return entries;
+   }
+};
+
+// One argument unpacked from std::any for a parameter of type Arg.
+// An exact match is read in place through the pointer form of any_cast; otherwise the
+// value is converted into local storage. get() throws std::bad_any_cast only when the
+// type has no conversion at all, so a mismatched-but-convertible call never unwinds.
+template<typename Arg>
+class AnyArgument {
+public:
+   using Raw = std::decay_t<Arg>;
+
+   explicit AnyArgument(const std::any& a) : m_value(std::any_cast<Raw>(&a)) {
+      if (!m_value) {
+         if (auto convert = ArgumentConversions<Raw>::find(a.type())) {
+            m_converted.emplace(convert(a));
+            m_value = &*m_converted;
+         }
+      }
+   }
+
+   AnyArgument(const AnyArgument&) = delete;
+   AnyArgument& operator=(const AnyArgument&) = delete;
+
+   const Raw& get() const {
+      if (!m_value) {
+         throw std::bad_any_cast();
+      }
+      return *m_value;
+   }
+
+private:
+   const Raw* m_value;
+   std::optional<Raw> m_converted;
 };
 
 template<typename Ret, typename... Args>
 class Callback : public CallbackBase {
 public:
-   explicit Callback(const std::function<Ret(Args...)>& func) : m_func(func) {}
+   explicit Callback(const std::function<Ret(Args...)>& func) : m_func(func) {
+      // Build the conversion plan for every parameter now rather than on the first call
+      (ArgumentConversions<std::decay_t<Args>>::table(), ...);
+   }
+
+   const void* signature() const override { return signatureOf<Ret(Args...)>(); }
+   const std::function<Ret(Args...)>& function() const { return m_func; }
 
    std::any invoke(const std::vector<std::any>& params) const override {
       if (params.size() != sizeof...(Args)) {
@@ -38,57 +171,26 @@ public:
 private:
    std::function<Ret(Args...)> m_func;
 
-   // Helper function to cast std::any to the target parameter type, handling common conversions
-   template<typename TargetType>
-   TargetType cast_any_to_target(const std::any& a) const {
-      try {
-         // Attempt direct cast first (handles exact type matches, including const/ref)
-         return std::any_cast<TargetType>(a);
-      }
-      catch (const std::bad_any_cast&) {
-         // If direct cast fails, try common conversions
-
-         // Case: Target is std::string or const std::string&, any holds const char* (from literal)
-         if constexpr (std::is_same_v<std::decay_t<TargetType>, std::string>) {
-            if (a.type() == typeid(const char*)) {
-               // Cast const char* out, construct a std::string, then static_cast to TargetType
-               // This handles converting const char* to std::string or binding it to const std::string&
-               return static_cast<TargetType>(std::string(std::any_cast<const char*>(a)));
-            }
-         }
-
-         // Add other common conversions here if needed, e.g.:
-         // Case: Target is arithmetic type (int, double, float etc.), any holds another arithmetic type
-         if constexpr (std::is_arithmetic_v<std::decay_t<TargetType>>) {
-            using RawTarget = std::decay_t<TargetType>;
-            if (a.type() == typeid(int) && std::is_convertible_v<int, RawTarget>) {
-               return static_cast<TargetType>(static_cast<RawTarget>(std::any_cast<int>(a)));
-            }
-            if (a.type() == typeid(double) && std::is_convertible_v<double, RawTarget>) {
-               return static_cast<TargetType>(static_cast<RawTarget>(std::any_cast<double>(a)));
-            }
-            // ... add conversions for other arithmetic types if necessary
-         }
-
-
-         // If no specific conversion matched, re-throw the original bad_any_cast
-         throw;
-      }
-   }
 
 
    template<size_t... Is>
    Ret invokeImpl(const std::vector<std::any>& params, std::index_sequence<Is...>) const {
-      // Use the cast_any_to_target helper to get the correct argument types
-      // std::tuple_element_t<Is, std::tuple<Args...>> gets the Ith type from the Args... pack
-      return m_func(cast_any_to_target<std::tuple_element_t<Is, std::tuple<Args...>>>(params[Is])...);
+      // Each AnyArgument temporary lives until m_func returns, so converted values can bind to
+      // const reference parameters. std::tuple_element_t<Is, std::tuple<Args...>> is the Ith type
+      return m_func(AnyArgument<std::tuple_element_t<Is, std::tuple<Args...>>>(params[Is]).get()...);
    }
 };
 
 template<typename... Args>
 class Callback<void, Args...> : public CallbackBase {
 public:
-   explicit Callback(const std::function<void(Args...)>& func) : m_func(func) {}
+   explicit Callback(const std::function<void(Args...)>& func) : m_func(func) {
+      // Build the conversion plan for every parameter now rather than on the first call
+      (ArgumentConversions<std::decay_t<Args>>::table(), ...);
+   }
+
+   const void* signature() const override { return signatureOf<void(Args...)>(); }
+   const std::function<void(Args...)>& function() const { return m_func; }
 
    std::any invoke(const std::vector<std::any>& params) const override {
       // For void return types, invoke just calls invokeVoid and returns an empty any
@@ -106,82 +208,79 @@ public:
 private:
    std::function<void(Args...)> m_func;
 
-   // Helper function to cast std::any to the target parameter type, handling common conversions
-   template<typename TargetType>
-   TargetType cast_any_to_target(const std::any& a) const {
-      try {
-         // Attempt direct cast first (handles exact type matches, including const/ref)
-         return std::any_cast<TargetType>(a);
-      }
-      catch (const std::bad_any_cast&) {
-         // If direct cast fails, try common conversions
-
-         // Case: Target is std::string or const std::string&, any holds const char* (from literal)
-         if constexpr (std::is_same_v<std::decay_t<TargetType>, std::string>) {
-            if (a.type() == typeid(const char*)) {
-               // Cast const char* out, construct a std::string, then static_cast to TargetType
-               return static_cast<TargetType>(std::string(std::any_cast<const char*>(a)));
-            }
-         }
-
-         // Add other common conversions here if needed (e.g., arithmetic)
-         if constexpr (std::is_arithmetic_v<std::decay_t<TargetType>>) {
-            using RawTarget = std::decay_t<TargetType>;
-            if (a.type() == typeid(int) && std::is_convertible_v<int, RawTarget>) {
-               return static_cast<TargetType>(static_cast<RawTarget>(std::any_cast<int>(a)));
-            }
-            if (a.type() == typeid(double) && std::is_convertible_v<double, RawTarget>) {
-               return static_cast<TargetType>(static_cast<RawTarget>(std::any_cast<double>(a)));
-            }
-            // ... add conversions for other arithmetic types if necessary
-         }
-
-
-         // If no specific conversion matched, re-throw
-         throw;
-      }
-   }
 
    template<size_t... Is>
    void invokeImpl(const std::vector<std::any>& params, std::index_sequence<Is...>) const {
-      // Use the cast_any_to_target helper to get the correct argument types
-      // std::tuple_element_t<Is, std::tuple<Args...>> gets the Ith type from the Args... pack
-      m_func(cast_any_to_target<std::tuple_element_t<Is, std::tuple<Args...>>>(params[Is])...);
+      // Each AnyArgument temporary lives until m_func returns, so converted values can bind to
+      // const reference parameters. std::tuple_element_t<Is, std::tuple<Args...>> is the Ith type
+      m_func(AnyArgument<std::tuple_element_t<Is, std::tuple<Args...>>>(params[Is]).get()...);
    }
 };
 
+template<typename Sig>
+struct SignatureTraits;
+
+template<typename Ret, typename... Args>
+struct SignatureTraits<Ret(Args...)> {
+   using return_type = Ret;
+   using callback_type = Callback<Ret, Args...>;
+};
+
 class RxCallbackManager {
 public:
+   // Ids in [0, denseIdLimit) are looked up by direct index; pass 0 to hash every id.
+   // executor runs invokeAsync calls; null means the process-wide ThreadPoolExecutor::shared()
+   explicit RxCallbackManager(size_t denseIdLimit = DenseIdTable<CallbackSlot>::DefaultDenseLimit,
+      std::shared_ptr<IExecutor> executor = nullptr)
+      : m_callbacks(denseIdLimit), m_executor(executor ? std::move(executor) : ThreadPoolExecutor::shared()) {}
+
+   // Every registration returns a typed handle for the zero-allocation call path
    template<typename Ret, typename... Args>
-   void registerCallback(const int& id, std::function<Ret(Args...)> func) {
-      m_callbacks[id] = std::make_unique<Callback<Ret, Args...>>(func);
+   CallbackHandle<Ret(Args...)> registerCallback(const int& id, std::function<Ret(Args...)> func) {
+      auto& callback = m_callbacks.slot(id).template emplace<Callback<Ret, Args...>>(func);
+      return CallbackHandle<Ret(Args...)>(&callback.function());
    }
 
    template<typename Ret, typename... Args>
-   void registerCallback(const int& id, Ret(*func)(Args...)) {
-      registerCallback(id, std::function<Ret(Args...)>(func));
+   CallbackHandle<Ret(Args...)> registerCallback(const int& id, Ret(*func)(Args...)) {
+      return registerCallback(id, std::function<Ret(Args...)>(func));
    }
 
    template<typename C, typename Ret, typename... Args>
-   void registerCallback(const int& id, Ret(C::* method)(Args...), C* instance) {
+   CallbackHandle<Ret(Args...)> registerCallback(const int& id, Ret(C::* method)(Args...), C* instance) {
       auto func = [instance, method](Args... args) -> Ret {
          return (instance->*method)(std::forward<Args>(args)...);
       };
-      registerCallback(id, std::function<Ret(Args...)>(func));
+      return registerCallback(id, std::function<Ret(Args...)>(func));
    }
 
    template<typename C, typename Ret, typename... Args>
-   void registerCallback(const int& id, Ret(C::* method)(Args...) const, const C* instance) {
+   CallbackHandle<Ret(Args...)> registerCallback(const int& id, Ret(C::* method)(Args...) const, const C* instance) {
       auto func = [instance, method](Args... args) -> Ret {
          return (instance->*method)(std::forward<Args>(args)...);
       };
-      registerCallback(id, std::function<Ret(Args...)>(func));
+      return registerCallback(id, std::function<Ret(Args...)>(func));
+   }
+
+   // Looks the callback up and verifies its signature once; the handle then calls it directly.
+   // Sig must match the registered signature exactly, e.g. void(int, int, const std::string&).
+   template<typename Sig>
+   CallbackHandle<Sig> getHandle(const int& id) const {
+      return CallbackHandle<Sig>(&findTyped<Sig>(id).function());
+   }
+
+   // Typed invocation: signature checked by key comparison, arguments perfectly forwarded
+   // to the stored function. No std::any, no heap allocation, no exceptions unless the id
+   // is unknown or Sig does not match.
+   template<typename Sig, typename... CallArgs>
+   typename SignatureTraits<Sig>::return_type invokeTyped(const int& id, CallArgs&&... args) const {
+      return findTyped<Sig>(id).function()(std::forward<CallArgs>(args)...);
    }
 
    template<typename Ret, typename... Args>
    Ret invoke(const int& id, Args&&... args) {
-      auto it = m_callbacks.find(id);
-      if (it == m_callbacks.end()) {
+      CallbackBase* callback = m_callbacks.get(id);
+      if (!callback) {
          throw std::runtime_error("Callback not found: " + std::to_string(id));
       }
 
@@ -189,30 +288,39 @@ public:
       std::vector<std::any> params{ std::forward<Args>(args)... };
 
       // Invoke the callback base method, which will handle casting inside
-      std::any result = it->second->invoke(params);
+      return castResult<Ret>(callback->invoke(params));
+   }
 
-      // Cast the result back to the expected return type
-      // This assumes the caller expects the correct return type.
-      if constexpr (!std::is_same_v<Ret, void>) {
-         try {
-            return std::any_cast<Ret>(result);
-         }
-         catch (const std::bad_any_cast&) {
-            throw std::runtime_error("Failed to cast callback return type");
-         }
+   // Runs the callback on the executor and returns immediately. Arguments are copied into the
+   // task (pointer arguments must stay valid until it runs), and the callback must stay
+   // registered until the future is ready. Errors, including an unknown id, arrive through
+   // the future.
+   template<typename Ret, typename... Args>
+   CallbackFuture<Ret> invokeAsync(const int& id, Args&&... args) {
+      CallbackPromise<Ret> promise(m_executor);
+      CallbackFuture<Ret> future = promise.getFuture();
+
+      CallbackBase* callback = m_callbacks.get(id);
+      if (!callback) {
+         promise.setException(std::make_exception_ptr(std::runtime_error("Callback not found: " + std::to_string(id))));
+         return future;
       }
-      else {
-         // If Ret is void, invoke doesn't return a meaningful value, just check the callback type was indeed void
-         if (!result.has_value()) return; // std::any() was returned as expected
-         // If result had a value but Ret is void, something is wrong
-         throw std::runtime_error("Invoked void callback but received non-empty return value");
+
+      std::vector<std::any> params{ std::forward<Args>(args)... };
+      bool posted = m_executor->post([callback, promise, params = std::move(params)]() mutable {
+         auto call = [&] { return castResult<Ret>(callback->invoke(params)); };
+         promise.setWith(call);
+      });
+      if (!posted) {
+         promise.setException(std::make_exception_ptr(std::runtime_error("Callback executor is shut down")));
       }
+      return future;
    }
 
    template<typename... Args>
    void invokeVoid(const int& id, Args&&... args) {
-      auto it = m_callbacks.find(id);
-      if (it == m_callbacks.end()) {
+      CallbackBase* callback = m_callbacks.get(id);
+      if (!callback) {
          throw std::runtime_error("Callback not found: " + std::to_string(id));
       }
 
@@ -220,11 +328,11 @@ public:
       std::vector<std::any> params{ std::forward<Args>(args)... };
 
       // Invoke the callback base method, which will handle casting inside
-      it->second->invokeVoid(params);
+      callback->invokeVoid(params);
    }
 
    bool hasCallback(const int& id) const {
-      return m_callbacks.find(id) != m_callbacks.end();
+      return m_callbacks.get(id) != nullptr;
    }
 
    void removeCallback(const int& id) {
@@ -232,5 +340,39 @@ public:
    }
 
 private:
-   std::map<int, std::unique_ptr<CallbackBase>> m_callbacks;
+   // Cast the result back to the expected return type
+   // This assumes the caller expects the correct return type.
+   template<typename Ret>
+   static Ret castResult(std::any result) {
+      if constexpr (!std::is_same_v<Ret, void>) {
+         if (auto* value = std::any_cast<std::remove_cv_t<std::remove_reference_t<Ret>>>(&result)) {
+            return *value;
+         }
+         throw std::runtime_error("Failed to cast callback return type");
+      }
+      else {
+         // If Ret is void, invoke doesn't return a meaningful value, just check the callback type was indeed void
+         if (!result.has_value()) return; // std::any() was returned as expected
+         // If result had a value but Ret is void, something is wrong
+         throw std::runtime_error("Invoked void callback but received non-empty return value");
+      }
+   }
+
+   template<typename Sig>
+   const typename SignatureTraits<Sig>::callback_type& findTyped(const int& id) const {
+      CallbackBase* callback = m_callbacks.get(id);
+      if (!callback) {
+         throw std::runtime_error("Callback not found: " + std::to_string(id));
+      }
+      if (callback->signature() != signatureOf<Sig>()) {
+         throw std::runtime_error("Callback signature mismatch: " + std::to_string(id));
+      }
+      return static_cast<const typename SignatureTraits<Sig>::callback_type&>(*callback);
+   }
+
+   // Callback objects are stored in the slot itself when small enough
+   using CallbackSlot = InlineObject<CallbackBase>;
+
+   DenseIdTable<CallbackSlot> m_callbacks;
+   std::shared_ptr<IExecutor> m_executor; // set once in the constructor; invokeAsync only reads it
 };
\ No newline at end of file
@@ -0,0 +1,124 @@
+#pragma once
+#include <algorithm>
+#include <cstddef> // For size_t, std::max_align_t
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+// Holds one polymorphic object. When the concrete type fits InlineSize bytes it is constructed
+// directly in the holder, so a registry slot and its callback share the same few cache lines;
+// larger types fall back to a heap allocation. The default size fits a vtable pointer plus a
+// std::function on MSVC, libstdc++ and libc++.
+template<typename Base, size_t InlineSize = 80>
+class InlineObject {
+public:
+   InlineObject() = default;
+   ~InlineObject() { reset(); }
+
+   InlineObject(const InlineObject&) = delete;
+   InlineObject& operator=(const InlineObject&) = delete;
+
+   // Destroys the current object (if any) and constructs a T in its place
+   template<typename T, typename... CtorArgs>
+   T& emplace(CtorArgs&&... args) {
+      static_assert(std::is_base_of_v<Base, T>, "InlineObject: T must derive from Base");
+      reset();
+      T* object;
+      if constexpr (sizeof(T) <= InlineSize && alignof(T) <= alignof(std::max_align_t)) {
+         object = new (m_storage) T(std::forward<CtorArgs>(args)...);
+         m_inline = true;
+      }
+      else {
+         object = new T(std::forward<CtorArgs>(args)...);
+         m_inline = false;
+      }
+      m_object = object;
+      return *object;
+   }
+
+   void reset() {
+      if (!m_object) {
+         return;
+      }
+      if (m_inline) {
+         m_object->~Base();
+      }
+      else {
+         delete m_object;
+      }
+      m_object = nullptr;
+   }
+
+   Base* get() const { return m_object; }
+   explicit operator bool() const { return m_object != nullptr; }
+
+private:
+   Base* m_object = nullptr;
+   bool m_inline = false;
+   alignas(std::max_align_t) unsigned char m_storage[InlineSize];
+};
+
+// Callback table for small, dense integer ids (e.g. the MessageId enum).
+// Ids in [0, denseLimit) index a contiguous array allocated once up front, so a lookup is a
+// single indexed load and slots never move (references and handles stay valid); any other id
+// falls back to a hash map. A denseLimit of 0 keeps every id in the hash map.
+// Slot is the per-id holder: InlineObject<...> or std::shared_ptr<...>; an empty slot means
+// "not registered".
+template<typename Slot>
+class DenseIdTable {
+public:
+   static constexpr size_t DefaultDenseLimit = 64;
+
+   explicit DenseIdTable(size_t denseLimit = DefaultDenseLimit)
+      : m_dense(denseLimit > 0 ? std::make_unique<Slot[]>(denseLimit) : nullptr),
+        m_denseLimit(denseLimit) {}
+
+   // Copies every slot; only available for copyable slots (used for copy-on-write snapshots)
+   DenseIdTable(const DenseIdTable& other)
+      : m_dense(other.m_denseLimit > 0 ? std::make_unique<Slot[]>(other.m_denseLimit) : nullptr),
+        m_denseLimit(other.m_denseLimit),
+        m_sparse(other.m_sparse) {
+      std::copy(other.m_dense.get(), other.m_dense.get() + m_denseLimit, m_dense.get());
+   }
+
+   DenseIdTable& operator=(const DenseIdTable&) = delete;
+
+   // Slot for id, created empty if it does not exist yet
+   Slot& slot(int id) {
+      if (isDense(id)) {
+         return m_dense[static_cast<size_t>(id)];
+      }
+      return m_sparse[id];
+   }
+
+   // Raw pointer to the object registered for id, nullptr if none
+   auto get(int id) const -> decltype(std::declval<const Slot&>().get()) {
+      if (isDense(id)) {
+         return m_dense[static_cast<size_t>(id)].get();
+      }
+      auto it = m_sparse.find(id);
+      return it != m_sparse.end() ? it->second.get() : nullptr;
+   }
+
+   void erase(int id) {
+      if (isDense(id)) {
+         m_dense[static_cast<size_t>(id)].reset();
+      }
+      else {
+         m_sparse.erase(id);
+      }
+   }
+
+   size_t denseLimit() const { return m_denseLimit; }
+
+private:
+   bool isDense(int id) const {
+      return id >= 0 && static_cast<size_t>(id) < m_denseLimit;
+   }
+
+   std::unique_ptr<Slot[]> m_dense;
+   size_t m_denseLimit;
+   std::unordered_map<int, Slot> m_sparse;
+};
\ No newline at end of file
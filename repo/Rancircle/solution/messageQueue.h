@@ -1,51 +1,151 @@
 #pragma once
 #include <vector>
 #include <any>
+#include <chrono>
 #include <functional>
 #include <memory>
 #include <variant>
 #include <map>
+#include <string>
+#include "SharedBuffer.h"
+#include "ParameterPack.h"
+#include "MessagePayload.h"
+#include "CpuTopology.h"
+#include "Metrics.h"
+#include "callbackFuture.hpp"
 
 class IMessageQueue {
 public:
    using MessageId = int;
-   using Parameter = std::variant<int, float, double, std::string>;
-   using MessageHandler = std::function<void(const std::vector<Parameter>&)>;
+   using Parameter = std::variant<int, float, double, std::string, SharedBuffer>;
+   // Up to four parameters are stored inline: queuing a message with numeric parameters
+   // does not allocate, and the pack is moved from QueueMessage through to the handler
+   using ParameterPack = BasicParameterPack<Parameter, 4>;
+   using MessageHandler = std::function<void(const ParameterPack&)>;
+
+   // Request/reply: a request handler returns the reply parameters, which complete the
+   // caller's future (matched by a correlation id carried with the message)
+   using Reply = ParameterPack;
+   using RequestHandler = std::function<Reply(const ParameterPack&)>;
+   using ReplyFuture = CallbackFuture<Reply>;
+
+   static constexpr std::chrono::milliseconds DefaultRequestTimeout{ 5000 };
+
+   // Batching: QueueMessages publishes a whole batch with one synchronization point and one
+   // wakeup, and workers drain up to the batch size per wakeup. A batch handler receives the
+   // parameters of each run of consecutive messages with its id, in queue order.
+   struct BatchMessage {
+      MessageId id;
+      ParameterPack params;
+   };
+   using BatchHandler = std::function<void(const std::vector<ParameterPack>&)>;
+
+   static constexpr size_t DefaultBatchSize = 32;
+
+   // Typed messages (see TypedMessage.h): the argument tuple travels as a MessagePayload
+   // instead of a ParameterPack. decode rebuilds it from its fixed-layout encoding when the
+   // message arrives from another process.
+   struct PayloadHandler {
+      std::function<void(const MessagePayload&)> handle;
+      bool (*decode)(const unsigned char* src, size_t size, MessagePayload& payload);
+   };
+
+   // Fan-out: runs once every handler of a fanned-out message has returned
+   using JoinHandler = std::function<void(MessageId, const ParameterPack&)>;
 
    virtual ~IMessageQueue() = default;
    virtual void Start() = 0;
    virtual void Stop() = 0;
    virtual void SetThreadCount(size_t numThreads) = 0;
    virtual void RegisterHandler(MessageId id, MessageHandler handler) = 0;
+   // One request handler per id; registering again replaces it
+   virtual void RegisterRequestHandler(MessageId id, RequestHandler handler) = 0;
+   // Batch handlers run after the per-message handlers of the same id
+   virtual void RegisterBatchHandler(MessageId id, BatchHandler handler) = 0;
+   // Maximum number of messages a worker takes per wakeup (0 is treated as 1)
+   virtual void SetBatchSize(size_t maxMessages) = 0;
+   // Typed handlers are separate from the ParameterPack handlers of the same id
+   virtual void RegisterPayloadHandler(MessageId id, PayloadHandler handler) = 0;
+   // Opt-in parallel fan-out: the handlers of id run as independent tasks on executor (the
+   // shared thread pool if null) instead of one after another on the worker, all reading one
+   // shared copy of the parameters; onJoin (may be empty) runs once the last of them has
+   // returned. Handlers of consecutive messages may then overlap. Stop() waits for them.
+   virtual void SetFanOut(MessageId id, bool parallel, JoinHandler onJoin,
+      std::shared_ptr<IExecutor> executor = nullptr) = 0;
+   // CPUs the workers run on; applies to running workers at once and to workers added later
+   virtual void SetWorkerPlacement(const WorkerPlacement& placement) = 0;
+   // Instrumentation (see Metrics.h): per-id enqueue, dispatch, drop and handler exception
+   // counts, queue depth, wait and handler latencies. Off by default.
+   virtual void EnableMetrics(bool enabled) = 0;
+   virtual MetricsSnapshot SnapshotMetrics() const = 0;
+
+   // Any number of parameters; beyond four the pack spills to the heap
+   template<typename... Args>
+   void QueueMessage(MessageId id, Args... args) {
+      QueueMessageImpl(id, MakeParameters(std::move(args)...));
+   }
 
-   void QueueMessage(MessageId id) {
-      QueueMessageImpl(id, {});
+   void QueuePayload(MessageId id, MessagePayload&& payload) {
+      QueuePayloadImpl(id, std::move(payload));
    }
 
-   template<typename T>
-   void QueueMessage(MessageId id, T p1) {
-      std::vector<Parameter> params{ Parameter(p1) };
-      QueueMessageImpl(id, params);
+   void QueueMessages(const BatchMessage* messages, size_t count) {
+      if (count > 0) {
+         QueueMessagesImpl(messages, count);
+      }
    }
 
-   template<typename T1, typename T2>
-   void QueueMessage(MessageId id, T1 p1, T2 p2) {
-      std::vector<Parameter> params{ Parameter(p1), Parameter(p2) };
-      QueueMessageImpl(id, params);
+   void QueueMessages(const std::vector<BatchMessage>& messages) {
+      QueueMessages(messages.data(), messages.size());
    }
 
-   template<typename T1, typename T2, typename T3>
-   void QueueMessage(MessageId id, T1 p1, T2 p2, T3 p3) {
-      std::vector<Parameter> params{ Parameter(p1), Parameter(p2), Parameter(p3) };
-      QueueMessageImpl(id, params);
+   // Queues a request and returns a future for the reply. The future fails with
+   // RequestTimeoutException when no reply arrives in time, RequestFailedException when the
+   // receiver has no request handler for id, or the handler's exception (carried as a
+   // RequestFailedException with its message when it crosses processes).
+   template<typename... Args>
+   ReplyFuture Request(MessageId id, Args... args) {
+      return RequestWithTimeout(DefaultRequestTimeout, id, args...);
    }
 
-   template<typename T1, typename T2, typename T3, typename T4>
-   void QueueMessage(MessageId id, T1 p1, T2 p2, T3 p3, T4 p4) {
-      std::vector<Parameter> params{ Parameter(p1), Parameter(p2), Parameter(p3), Parameter(p4) };
-      QueueMessageImpl(id, params);
+   // A timeout of zero waits forever
+   template<typename... Args>
+   ReplyFuture RequestWithTimeout(std::chrono::milliseconds timeout, MessageId id, Args... args) {
+      return RequestImpl(id, MakeParameters(std::move(args)...), timeout);
    }
 
 protected:
-   virtual void QueueMessageImpl(MessageId id, const std::vector<Parameter>& params) = 0;
+   // Builds each parameter in place in the pack
+   template<typename... Args>
+   static ParameterPack MakeParameters(Args&&... args) {
+      ParameterPack params;
+      (params.emplace_back(std::forward<Args>(args)), ...);
+      return params;
+   }
+
+   // params is an rvalue so implementations can move it into the queued message
+   virtual void QueueMessageImpl(MessageId id, ParameterPack&& params) = 0;
+   // Default: queues the messages one by one
+   virtual void QueueMessagesImpl(const BatchMessage* messages, size_t count) {
+      for (size_t i = 0; i < count; ++i) {
+         QueueMessageImpl(messages[i].id, ParameterPack(messages[i].params));
+      }
+   }
+   virtual ReplyFuture RequestImpl(MessageId id, ParameterPack&& params, std::chrono::milliseconds timeout) = 0;
+   virtual void QueuePayloadImpl(MessageId id, MessagePayload&& payload) = 0;
+
+   // For queues that route messages on to other queues (NumaMessageQueue) without repacking
+   static void Forward(IMessageQueue& target, MessageId id, ParameterPack&& params) {
+      target.QueueMessageImpl(id, std::move(params));
+   }
+   static void Forward(IMessageQueue& target, const BatchMessage* messages, size_t count) {
+      target.QueueMessagesImpl(messages, count);
+   }
+   static void Forward(IMessageQueue& target, MessageId id, MessagePayload&& payload) {
+      target.QueuePayloadImpl(id, std::move(payload));
+   }
+   static ReplyFuture ForwardRequest(IMessageQueue& target, MessageId id, ParameterPack&& params,
+      std::chrono::milliseconds timeout) {
+      return target.RequestImpl(id, std::move(params), timeout);
+   }
 };
\ No newline at end of file
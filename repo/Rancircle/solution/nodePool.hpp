@@ -0,0 +1,171 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Counters of a node pool. Hit rate = reused / acquired.
+struct PoolStats {
+   uint64_t acquired = 0;     // nodes handed out
+   uint64_t reused = 0;       // ... that recycled a node instead of growing the pool
+   size_t highWaterMark = 0;  // nodes the pool has grown to (it never shrinks)
+};
+
+// Free-list allocator for nodes of type T, one per node type (NodePool<T>::instance()).
+// Nodes are carved from arena chunks that are never handed back to the heap, so a steady
+// workload stops calling malloc once the arena has reached its peak. Each thread keeps a
+// small cache of free nodes that create()/destroy() use without locking; nodes move between
+// the caches and the shared free list CacheBatch at a time, so a node created on a producer
+// and destroyed on a worker costs one lock per batch instead of a contended free each.
+template<typename T>
+class NodePool {
+   union Node {
+      Node* next;
+      alignas(T) unsigned char storage[sizeof(T)];
+   };
+
+   struct ThreadCache {
+      Node* head = nullptr;
+      size_t count = 0;
+      std::atomic<uint64_t> acquired{ 0 }; // written by the owning thread only
+      bool registered = false;
+
+      ~ThreadCache() {
+         if (registered) {
+            instance().retireCache(*this);
+         }
+      }
+   };
+
+public:
+   static constexpr size_t ChunkNodes = 64;
+   static constexpr size_t CacheBatch = 32;
+   static constexpr size_t CacheLimit = 2 * CacheBatch;
+
+   // Intentionally leaked: thread caches return their nodes from thread-exit handlers,
+   // which may run after static destruction has started.
+   static NodePool& instance() {
+      static NodePool* pool = new NodePool();
+      return *pool;
+   }
+
+   template<typename... Args>
+   T* create(Args&&... args) {
+      ThreadCache& cache = localCache();
+      if (!cache.head) {
+         refill(cache);
+      }
+      Node* node = cache.head;
+      Node* next = node->next;
+      try {
+         new (node->storage) T(std::forward<Args>(args)...);
+      }
+      catch (...) {
+         node->next = next; // the failed constructor may have written over the link
+         throw;
+      }
+      cache.head = next;
+      --cache.count;
+      cache.acquired.store(cache.acquired.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return reinterpret_cast<T*>(node->storage);
+   }
+
+   // Destroys object and keeps its node in the calling thread's cache
+   void destroy(T* object) {
+      if (!object) {
+         return;
+      }
+      object->~T();
+      Node* node = reinterpret_cast<Node*>(object);
+      ThreadCache& cache = localCache();
+      node->next = cache.head;
+      cache.head = node;
+      if (++cache.count > CacheLimit) {
+         flush(cache, CacheBatch);
+      }
+   }
+
+   PoolStats stats() {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      PoolStats result;
+      result.acquired = m_retiredAcquired;
+      for (ThreadCache* cache : m_caches) {
+         result.acquired += cache->acquired.load(std::memory_order_relaxed);
+      }
+      result.highWaterMark = m_carved;
+      result.reused = result.acquired > m_carved ? result.acquired - m_carved : 0;
+      return result;
+   }
+
+private:
+   NodePool() = default;
+
+   static ThreadCache& localCache() {
+      thread_local ThreadCache cache;
+      return cache;
+   }
+
+   // Moves up to CacheBatch nodes into cache: recycled ones from the shared free list first,
+   // then fresh ones carved from the arena (which grows by a chunk when it runs out)
+   void refill(ThreadCache& cache) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!cache.registered) {
+         m_caches.push_back(&cache);
+         cache.registered = true;
+      }
+      for (size_t i = 0; i < CacheBatch; ++i) {
+         Node* node = m_free;
+         if (node) {
+            m_free = node->next;
+         }
+         else {
+            if (m_chunkUsed == ChunkNodes || m_chunks.empty()) {
+               m_chunks.emplace_back(new Node[ChunkNodes]);
+               m_chunkUsed = 0;
+            }
+            node = &m_chunks.back()[m_chunkUsed++];
+            ++m_carved;
+         }
+         node->next = cache.head;
+         cache.head = node;
+         ++cache.count;
+      }
+   }
+
+   void flush(ThreadCache& cache, size_t count) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for (size_t i = 0; i < count && cache.head; ++i) {
+         Node* node = cache.head;
+         cache.head = node->next;
+         --cache.count;
+         node->next = m_free;
+         m_free = node;
+      }
+   }
+
+   // Thread exit: hands the cached nodes and the thread's counter to the pool
+   void retireCache(ThreadCache& cache) {
+      flush(cache, cache.count);
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_retiredAcquired += cache.acquired.load(std::memory_order_relaxed);
+      for (size_t i = 0; i < m_caches.size(); ++i) {
+         if (m_caches[i] == &cache) {
+            m_caches[i] = m_caches.back();
+            m_caches.pop_back();
+            break;
+         }
+      }
+   }
+
+   std::mutex m_mutex;
+   Node* m_free = nullptr;
+   size_t m_chunkUsed = 0; // nodes of the newest chunk carved so far
+   size_t m_carved = 0;
+   uint64_t m_retiredAcquired = 0;
+   std::vector<std::unique_ptr<Node[]>> m_chunks;
+   std::vector<ThreadCache*> m_caches;
+};
\ No newline at end of file
@@ -0,0 +1,149 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Read-copy-update support for the callback tables.
+// A reader marks itself active on its own per-thread counter (odd while inside a read section)
+// and never writes shared memory, so lookups are wait-free and do not bounce cache lines
+// between cores. A writer publishes a new immutable snapshot and retires the old one; a
+// retired object is destroyed only after every reader that could still see it has left its
+// read section, so a callback replaced (or removed) while it is running finishes safely.
+// Writers never wait for readers: retired objects are reclaimed on later retire()/reclaim()
+// calls, which also makes it safe to register callbacks from inside a callback.
+class RcuDomain {
+   struct alignas(64) ReaderRecord {
+      std::atomic<uint64_t> counter{ 0 };
+      std::atomic<bool> inUse{ true };
+      ReaderRecord* next = nullptr;
+      unsigned depth = 0; // read-section nesting, touched by the owning thread only
+   };
+
+public:
+   // Process-wide domain. Intentionally leaked: thread-exit handlers may still release
+   // their reader records after static destruction has started.
+   static RcuDomain& instance() {
+      static RcuDomain* domain = new RcuDomain();
+      return *domain;
+   }
+
+   // Scope of a read section. Nested guards on the same thread are cheap and allowed.
+   class ReadGuard {
+   public:
+      ReadGuard() : m_record(localRecord()) {
+         if (m_record->depth++ == 0) {
+            m_record->counter.store(m_record->counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            // Order the announcement before the reader's loads of the shared snapshot
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+         }
+      }
+
+      ~ReadGuard() {
+         if (--m_record->depth == 0) {
+            m_record->counter.store(m_record->counter.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+         }
+      }
+
+      ReadGuard(const ReadGuard&) = delete;
+      ReadGuard& operator=(const ReadGuard&) = delete;
+
+   private:
+      ReaderRecord* m_record;
+   };
+
+   // Keeps object alive until every reader currently inside a read section has left it.
+   // Call after the object has been unpublished.
+   void retire(std::shared_ptr<const void> object) {
+      Retired item{ std::move(object), {} };
+      // Pairs with the fence in ReadGuard: a reader we do not see as active will see the new snapshot
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      for (ReaderRecord* record = m_readers.load(std::memory_order_acquire); record; record = record->next) {
+         uint64_t value = record->counter.load(std::memory_order_relaxed);
+         if (value & 1) {
+            item.activeReaders.emplace_back(record, value);
+         }
+      }
+      {
+         std::lock_guard<std::mutex> lock(m_retiredMutex);
+         m_retired.push_back(std::move(item));
+      }
+      reclaim();
+   }
+
+   // Destroys retired objects whose readers have all moved on
+   void reclaim() {
+      std::vector<Retired> done;
+      {
+         std::lock_guard<std::mutex> lock(m_retiredMutex);
+         for (size_t i = 0; i < m_retired.size(); ) {
+            if (isQuiescent(m_retired[i])) {
+               done.push_back(std::move(m_retired[i]));
+               m_retired[i] = std::move(m_retired.back());
+               m_retired.pop_back();
+            }
+            else {
+               ++i;
+            }
+         }
+      }
+      // done is destroyed here, outside the lock: destructors may retire more objects
+   }
+
+private:
+   struct Retired {
+      std::shared_ptr<const void> object;
+      std::vector<std::pair<ReaderRecord*, uint64_t>> activeReaders;
+   };
+
+   // Releases the thread's record for reuse when the thread exits
+   struct LocalRecord {
+      ReaderRecord* record = nullptr;
+      ~LocalRecord() {
+         if (record) {
+            record->inUse.store(false, std::memory_order_release);
+         }
+      }
+   };
+
+   RcuDomain() = default;
+
+   static ReaderRecord* localRecord() {
+      thread_local LocalRecord local;
+      if (!local.record) {
+         local.record = instance().acquireRecord();
+      }
+      return local.record;
+   }
+
+   ReaderRecord* acquireRecord() {
+      for (ReaderRecord* record = m_readers.load(std::memory_order_acquire); record; record = record->next) {
+         bool expected = false;
+         if (!record->inUse.load(std::memory_order_relaxed)
+            && record->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            return record;
+         }
+      }
+      // Records are never freed, so the list only grows to the peak number of reader threads
+      auto* record = new ReaderRecord();
+      record->next = m_readers.load(std::memory_order_relaxed);
+      while (!m_readers.compare_exchange_weak(record->next, record, std::memory_order_release, std::memory_order_relaxed)) {
+      }
+      return record;
+   }
+
+   static bool isQuiescent(const Retired& item) {
+      for (const auto& reader : item.activeReaders) {
+         if (reader.first->counter.load(std::memory_order_acquire) == reader.second) {
+            return false;
+         }
+      }
+      return true;
+   }
+
+   std::atomic<ReaderRecord*> m_readers{ nullptr };
+   std::mutex m_retiredMutex;
+   std::vector<Retired> m_retired;
+};
\ No newline at end of file
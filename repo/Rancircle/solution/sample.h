@@ -89,6 +89,11 @@ public:
       return m_callbackManager.invoke<int>(2, data, quality);
    }
 
+   CallbackFuture<int> triggerProcessDataCallbackAsync(const std::string& data, double quality) {
+      std::cout << "CallbackUser: Triggering process data callback asynchronously..." << std::endl;
+      return m_callbackManager.invokeAsync<int>(2, data, quality);
+   }
+
 private:
    RxCallbackManager& m_callbackManager;
 };
\ No newline at end of file
@@ -55,7 +55,7 @@ int main()
          handler.handleIntVoid(msg);
       });
    dispatcher.onEvent(MyEvents::EVENT_ASYNC_INT_VOID, (intptr_t)12345, (void*)0xABCDEF01);
-   std::this_thread::sleep_for(std::chrono::seconds(1));  
+   dispatcher.drain();
    
    try {
       VideoProcessor processor;
@@ -95,6 +95,9 @@ int main()
    callbackUser.triggerVideoCallback(1920, 1080, "H.264");
    int result = callbackUser.triggerProcessDataCallback("TestData", 0.75);
    std::cout << "Process data result: " << result << std::endl;
+   auto asyncResult = callbackUser.triggerProcessDataCallbackAsync("AsyncData", 0.5)
+      .then([](int processed) { return processed * 2; });
+   std::cout << "Async process data result: " << asyncResult.get() << std::endl;
 
    // 직접 호출
     callbackManager.invokeVoid(4, "Hello from main");
@@ -104,7 +107,7 @@ int main()
 
    //Message Queue 테스트
    auto queue = std::make_unique<IPCMessageQueue>("TestQueue", 2);
-   queue->RegisterHandler(MSG_UPDATE, [](const std::vector<IMessageQueue::Parameter>& params) {
+   queue->RegisterHandler(MSG_UPDATE, [](const IMessageQueue::ParameterPack& params) {
       // Handle message
       std::cout << "Received MSG_UPDATE" << std::endl;
       });
@@ -117,6 +120,22 @@ int main()
    MSG_CALL(queue, MSG_UPDATE, 42, "Hello");   // 2개 매개변수
    MSG_CALL(queue, MSG_UPDATE, 1, 2, 3);       // 3개 매개변수
    MSG_CALL(queue, MSG_UPDATE, 1, 2, 3, 4);    // 4개 매개변수
+   MSG_CALL(queue, MSG_UPDATE, 1, 2, 3, 4, 5); // 개수 제한 없음
+
+   // Typed message: 인자 타입을 컴파일 시점에 검사합니다
+   MSG_UPDATE_Message::Handle(*queue, [](const int& code, const std::string& text) {
+      std::cout << "Typed MSG_UPDATE: " << code << " " << text << std::endl;
+      });
+   MSG_UPDATE_Message::Send(*queue, 42, "Hello");
+
+   // Request/reply: 응답은 future로 돌아옵니다
+   auto rpcQueue = MessageQueueFactory::CreateMessageQueue(MessageQueueType::Local);
+   rpcQueue->RegisterRequestHandler(MSG_PROCESS, [](const IMessageQueue::ParameterPack& params) {
+      return IMessageQueue::Reply{ std::get<int>(params[0]) * 2 };
+      });
+   rpcQueue->Start();
+   auto reply = rpcQueue->Request(MSG_PROCESS, 21).get();
+   std::cout << "MSG_PROCESS reply: " << std::get<int>(reply[0]) << std::endl;
 
    return 0;
 }
\ No newline at end of file
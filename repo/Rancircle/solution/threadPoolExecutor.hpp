@@ -0,0 +1,302 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <stdexcept>
+#include <iostream>
+#include <cstddef> // For size_t
+
+/// Pluggable executor interface used by the dispatchers and managers to run work off the caller's thread
+class IExecutor {
+public:
+   using Task = std::function<void()>;
+
+   virtual ~IExecutor() = default;
+
+   /// Schedules a task. Returns false when the executor no longer accepts work.
+   virtual bool post(Task task) = 0;
+
+   /// Blocks until every task posted so far has finished running
+   virtual void drain() = 0;
+
+   /// Stops accepting new work, drains in-flight tasks and releases the workers
+   virtual void shutdown() = 0;
+};
+
+/// Fixed-size worker pool with one queue per worker and work stealing.
+/// Producers are spread round-robin over the worker queues (a worker posting to itself
+/// stays on its own queue), idle workers steal from the back of their siblings' queues,
+/// and the total number of queued tasks is bounded: post() blocks while the pool is full.
+/// drain()/shutdown() must not be called from inside a task running on the same pool.
+class ThreadPoolExecutor : public IExecutor {
+public:
+   explicit ThreadPoolExecutor(size_t workerCount = defaultWorkerCount(), size_t queueCapacity = 4096)
+      : queues_(workerCount == 0 ? 1 : workerCount),
+        capacity_(queueCapacity == 0 ? 1 : queueCapacity)
+   {
+      workers_.reserve(queues_.size());
+      for (size_t i = 0; i < queues_.size(); ++i) {
+         workers_.emplace_back(&ThreadPoolExecutor::workerLoop, this, i);
+      }
+   }
+
+   ~ThreadPoolExecutor() override {
+      shutdown();
+   }
+
+   ThreadPoolExecutor(const ThreadPoolExecutor&) = delete;
+   ThreadPoolExecutor& operator=(const ThreadPoolExecutor&) = delete;
+
+   /// Process-wide pool shared by components that were not given an executor explicitly
+   static std::shared_ptr<ThreadPoolExecutor> shared() {
+      static std::shared_ptr<ThreadPoolExecutor> instance = std::make_shared<ThreadPoolExecutor>();
+      return instance;
+   }
+
+   static size_t defaultWorkerCount() {
+      size_t n = std::thread::hardware_concurrency();
+      return n == 0 ? 4 : n;
+   }
+
+   bool post(Task task) override {
+      if (!task) {
+         throw std::invalid_argument("ThreadPoolExecutor::post: empty task");
+      }
+
+      const bool fromWorker = (currentPool() == this);
+
+      // Reserve a slot against the bound before touching any queue.
+      // Workers are exempt so a task that posts follow-up work can never deadlock the pool.
+      size_t queued = pending_.load();
+      for (;;) {
+         if (!accepting_.load(std::memory_order_acquire)) {
+            return false;
+         }
+         if (queued < capacity_ || fromWorker) {
+            if (pending_.compare_exchange_weak(queued, queued + 1)) {
+               break;
+            }
+            continue;
+         }
+         std::unique_lock<std::mutex> lock(spaceMutex_);
+         ++blockedProducers_;
+         spaceCv_.wait(lock, [this] {
+            return pending_.load() < capacity_ || !accepting_.load(std::memory_order_acquire);
+            });
+         --blockedProducers_;
+         queued = pending_.load();
+      }
+      inFlight_.fetch_add(1, std::memory_order_acq_rel);
+
+      size_t index = fromWorker
+         ? currentWorker()
+         : nextQueue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+      {
+         std::lock_guard<std::mutex> lock(queues_[index].mutex);
+         queues_[index].tasks.push_back(std::move(task));
+      }
+
+      // Only pay for the wakeup when somebody is actually parked
+      if (sleepers_.load(std::memory_order_seq_cst) > 0) {
+         std::lock_guard<std::mutex> lock(idleMutex_);
+         idleCv_.notify_one();
+      }
+      return true;
+   }
+
+   void drain() override {
+      std::unique_lock<std::mutex> lock(drainMutex_);
+      drainCv_.wait(lock, [this] { return inFlight_.load(std::memory_order_acquire) == 0; });
+   }
+
+   void shutdown() override {
+      std::lock_guard<std::mutex> shutdownLock(shutdownMutex_);
+      if (workers_.empty()) {
+         return;
+      }
+
+      accepting_.store(false, std::memory_order_release);
+      {
+         std::lock_guard<std::mutex> lock(spaceMutex_);
+         spaceCv_.notify_all();
+      }
+      drain();
+
+      {
+         std::lock_guard<std::mutex> lock(idleMutex_);
+         stopping_.store(true, std::memory_order_release);
+      }
+      idleCv_.notify_all();
+      for (auto& worker : workers_) {
+         if (worker.joinable()) {
+            worker.join();
+         }
+      }
+      workers_.clear();
+   }
+
+   size_t workerCount() const { return queues_.size(); }
+   size_t capacity() const { return capacity_; }
+   size_t pendingCount() const { return pending_.load(std::memory_order_relaxed); }
+
+private:
+   /// Double-ended ring of tasks that keeps its capacity, so a busy pool does not allocate
+   /// (std::deque frees and reallocates a block every few dozen tasks as the queue cycles)
+   class TaskRing {
+   public:
+      bool empty() const { return count_ == 0; }
+      Task& front() { return slots_[head_]; }
+      Task& back() { return slots_[(head_ + count_ - 1) & (slots_.size() - 1)]; }
+
+      void push_back(Task&& task) {
+         if (count_ == slots_.size()) {
+            grow();
+         }
+         slots_[(head_ + count_) & (slots_.size() - 1)] = std::move(task);
+         ++count_;
+      }
+
+      /// Popping clears the slot so a task's captures are released with the task
+      void pop_front() {
+         slots_[head_] = nullptr;
+         head_ = (head_ + 1) & (slots_.size() - 1);
+         --count_;
+      }
+
+      void pop_back() {
+         back() = nullptr;
+         --count_;
+      }
+
+   private:
+      void grow() {
+         std::vector<Task> next(slots_.empty() ? 64 : slots_.size() * 2);
+         for (size_t i = 0; i < count_; ++i) {
+            next[i] = std::move(slots_[(head_ + i) & (slots_.size() - 1)]);
+         }
+         slots_.swap(next);
+         head_ = 0;
+      }
+
+      std::vector<Task> slots_; // size is zero or a power of two
+      size_t head_ = 0;
+      size_t count_ = 0;
+   };
+
+   struct WorkerQueue {
+      std::mutex mutex;
+      TaskRing tasks;
+   };
+
+   static ThreadPoolExecutor*& currentPool() {
+      thread_local ThreadPoolExecutor* pool = nullptr;
+      return pool;
+   }
+
+   static size_t& currentWorker() {
+      thread_local size_t index = 0;
+      return index;
+   }
+
+   // Owner takes from the front of its own queue (FIFO)
+   bool popLocal(size_t index, Task& task) {
+      std::lock_guard<std::mutex> lock(queues_[index].mutex);
+      if (queues_[index].tasks.empty()) {
+         return false;
+      }
+      task = std::move(queues_[index].tasks.front());
+      queues_[index].tasks.pop_front();
+      return true;
+   }
+
+   // Thieves take from the back so they rarely collide with the owner
+   bool steal(size_t thief, Task& task) {
+      for (size_t offset = 1; offset < queues_.size(); ++offset) {
+         size_t victim = (thief + offset) % queues_.size();
+         std::unique_lock<std::mutex> lock(queues_[victim].mutex, std::try_to_lock);
+         if (!lock.owns_lock() || queues_[victim].tasks.empty()) {
+            continue;
+         }
+         task = std::move(queues_[victim].tasks.back());
+         queues_[victim].tasks.pop_back();
+         return true;
+      }
+      return false;
+   }
+
+   void run(Task& task) {
+      pending_.fetch_sub(1);
+      if (blockedProducers_.load() > 0) {
+         std::lock_guard<std::mutex> lock(spaceMutex_);
+         spaceCv_.notify_one();
+      }
+
+      try {
+         task();
+      }
+      catch (const std::exception& e) {
+         std::cerr << "Executor task exception: " << e.what() << std::endl;
+      }
+      catch (...) {
+         std::cerr << "Executor task unknown exception" << std::endl;
+      }
+      task = nullptr;
+
+      if (inFlight_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+         std::lock_guard<std::mutex> lock(drainMutex_);
+         drainCv_.notify_all();
+      }
+   }
+
+   void workerLoop(size_t index) {
+      currentPool() = this;
+      currentWorker() = index;
+
+      Task task;
+      for (;;) {
+         if (popLocal(index, task) || steal(index, task)) {
+            run(task);
+            continue;
+         }
+
+         std::unique_lock<std::mutex> lock(idleMutex_);
+         sleepers_.fetch_add(1, std::memory_order_seq_cst);
+         idleCv_.wait(lock, [this] {
+            return pending_.load(std::memory_order_seq_cst) > 0 || stopping_.load(std::memory_order_acquire);
+            });
+         sleepers_.fetch_sub(1, std::memory_order_relaxed);
+         if (stopping_.load(std::memory_order_acquire) && pending_.load(std::memory_order_acquire) == 0) {
+            break;
+         }
+      }
+      currentPool() = nullptr;
+   }
+
+   std::vector<WorkerQueue> queues_;
+   std::vector<std::thread> workers_;
+   const size_t capacity_;
+
+   std::atomic<size_t> pending_{ 0 };   // queued, not yet picked up
+   std::atomic<size_t> inFlight_{ 0 };  // queued or running
+   std::atomic<size_t> nextQueue_{ 0 };
+   std::atomic<size_t> sleepers_{ 0 };
+   std::atomic<bool> accepting_{ true };
+   std::atomic<bool> stopping_{ false };
+
+   std::mutex idleMutex_;
+   std::condition_variable idleCv_;
+
+   std::mutex spaceMutex_;
+   std::condition_variable spaceCv_;
+   std::atomic<size_t> blockedProducers_{ 0 };
+
+   std::mutex drainMutex_;
+   std::condition_variable drainCv_;
+
+   std::mutex shutdownMutex_;
+};